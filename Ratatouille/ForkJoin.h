@@ -0,0 +1,618 @@
+/*
+ * ForkJoin.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** ForkJoin - run groups of independent tasks on a set of
+ *             ParallelThread helpers and the calling thread
+ *
+ *  A task is a member function registered under a task number
+ *  (0 .. ProcessPtr::maxSlots-1). fork() takes a group of tasks which
+ *  don't depend on each other. The first task of the group is kept for
+ *  the calling thread, so it never idle while the helpers work, the
+ *  others are handed to the free helpers. Tasks for which no helper is
+ *  free are run by the calling thread as well. join() run the kept
+ *  tasks and then wait for the helpers, so a chain of stages is written
+ *  as a sequence of fork()/join() pairs.
+ *  Each task is timed and the cost to hand a task to a helper (the
+ *  wake up and the wait for it) is measured as well. With adaptive
+ *  mode (default) a task is only handed to a helper when that save
+ *  more than the hand over, else it run inline after the kept tasks.
+ *  A task which was kept inline is only offloaded again when it save
+ *  twice the hand over, so small blocks don't flip each cycle.
+ *  While the adaptive mode keep anything inline, every probeBlocks
+ *  group is handed over anyway, so the hand over is measured again and
+ *  a single slow sample can't keep the tasks inline for good.
+ *  In adaptive mode the group is as well ordered by the measured cost,
+ *  the most expensive task is kept for the calling thread and the
+ *  cheaper ones go to the helpers, so the helpers are done when the
+ *  calling thread reach wait() and it don't block there.
+ *
+ *  usage:
+ *      ForkJoin jobs;
+ *      // optional set the number of helper threads before start,
+ *         default is 1, 0 run anything in the calling thread
+ *      jobs.setHelpers(n);
+ *      jobs.start();
+ *      // the helper threads are named "YourName", "YourName1", ...
+ *      jobs.setThreadName("YourName");
+ *      jobs.setPriority(priority, scheduling_class);
+ *      jobs.setTimeOut(microseconds);
+ *      // register the tasks
+ *      jobs.set<0, YourClass, &YourClass::stageA>(this);
+ *      jobs.set<1, YourClass, &YourClass::stageB>(this);
+ *      // run a group, the more expensive stage run here, the other
+ *      // goes to a helper (until the costs are measured stageA run here)
+ *      static const uint32_t group[] = {0, 1};
+ *      jobs.fork(group, 2);
+ *      jobs.join();
+ *      // or split join() to measure the two parts
+ *      jobs.runLocal();
+ *      jobs.wait();
+ *      // optional always offload when a helper is free
+ *      jobs.setAdaptive(false);
+ *      // the measured costs in nanoseconds
+ *      int64_t c = jobs.getCost(1);
+ *      int64_t h = jobs.getHandshake();
+ *      // optional trace the tasks, see RatatouilleTrace.h
+ *      jobs.set<0, YourClass, &YourClass::stageA>(this, "stage A");
+ *      jobs.setTrace(ringOfThisThread, ringsOfTheHelpers, count);
+ *      // a task could check if it run on a helper thread
+ *      if (jobs.isOffloaded(1)) ...
+ *      // the counters of each helper, see ParallelThread.h,
+ *      // with the shared pool the counters of the own hand overs
+ *      const ParallelThreadStats& s = jobs.getStats(0);
+ *      jobs.stop();
+ *
+ *  fork(), join(), runLocal() and wait() must be called from the
+ *  same thread, one group at a time.
+ *
+ *  ForkJoinPool - optional process wide pool of helper threads, shared
+ *                 by all ForkJoin instances which use it. Set the
+ *                 environment variable RATATOUILLE_POOL to enable it,
+ *                 to a number for the count of helpers, or to "auto"
+ *                 for one helper per core beside the calling thread,
+ *                 0 or a empty value keep it off.
+ *                 A helper is claimed by a single fork() until the
+ *                 matching wait(), when no helper is waiting right now
+ *                 the task run in the calling thread, fork() never wait
+ *                 for a helper. Each instance wait with its own time out,
+ *                 set by setTimeOut(). When a wait is dropped, the helper
+ *                 is given back only after it finished the task.
+ *                 attach() and detach() lock,
+ *                 call them outside of the real-time thread, the helpers
+ *                 are started by the first and stopped by the last one.
+ *
+ *  usage:
+ *      // use the shared pool instead of own helpers, before start()
+ *      jobs.useSharedPool(ForkJoinPool::get().enabled());
+ *      jobs.start();
+ *
+ *  HelperCpus   - optional cores for the helper threads. Set the
+ *                 environment variable RATATOUILLE_CPUS to a list of
+ *                 cores, like "2,3" or "2-5,8", for example the cores
+ *                 isolated by isolcpus/nohz_full. The own helpers of each
+ *                 ForkJoin take the next core of the list when started,
+ *                 round-robin over all instances, pool helper h is pinned
+ *                 to entry h of the list. Without the variable the helpers
+ *                 run on any core.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ParallelThread.h"
+#include "RatatouilleTrace.h"
+
+#pragma once
+
+#ifndef FORK_JOIN_H_
+#define FORK_JOIN_H_
+
+class HelperCpus
+{
+public:
+    static HelperCpus& get() {
+        static HelperCpus cpus;
+        return cpus;
+    }
+
+    inline bool enabled() const noexcept {
+        return count > 0;
+    }
+
+    // the next core in round-robin order, -1 when not configured
+    inline int32_t next() noexcept {
+        if (!count) return -1;
+        return cpus[counter.fetch_add(1, std::memory_order_relaxed) % count];
+    }
+
+    // the core for a fixed index, -1 when not configured
+    inline int32_t at(uint32_t i) const noexcept {
+        if (!count) return -1;
+        return cpus[i % count];
+    }
+
+private:
+    static const uint32_t maxCpus = 64;
+    int32_t cpus[maxCpus];
+    uint32_t count;
+    std::atomic<uint32_t> counter;
+
+    HelperCpus() : count(0), counter(0) {
+        const char* p = getenv("RATATOUILLE_CPUS");
+        if (p && *p && !parse(p)) {
+            fprintf(stderr, "ForkJoin: invalid RATATOUILLE_CPUS %s, use a list like 2,3 or 2-5\n", p);
+            count = 0;
+        }
+    }
+
+    // read a list like "2,3" or "2-5,8"
+    bool parse(const char* p) {
+        while (*p) {
+            char* end;
+            const long first = strtol(p, &end, 10);
+            if (end == p || first < 0) return false;
+            long last = first;
+            p = end;
+            if (*p == '-') {
+                last = strtol(p + 1, &end, 10);
+                if (end == p + 1 || last < first) return false;
+                p = end;
+            }
+            for (long c = first; c <= last && count < maxCpus; c++)
+                cpus[count++] = static_cast<int32_t>(c);
+            if (*p == ',') p++;
+            else if (*p) return false;
+        }
+        return count > 0;
+    }
+};
+
+class ForkJoinPool
+{
+public:
+    static const uint32_t maxHelpers = 16;
+
+    static ForkJoinPool& get() {
+        static ForkJoinPool pool;
+        return pool;
+    }
+
+    ~ForkJoinPool() {
+        for (uint32_t h = 0; h < size; h++)
+            helper[h].stop();
+    }
+
+    // true when the pool is enabled by RATATOUILLE_POOL
+    inline bool enabled() const noexcept {
+        return isEnabled;
+    }
+
+    inline uint32_t getSize() const noexcept {
+        return size;
+    }
+
+    void attach() {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (users++) return;
+        for (uint32_t h = 0; h < size; h++) {
+            helper[h].setThreadName("RT-pool" + std::to_string(h));
+            helper[h].setAffinity(HelperCpus::get().at(h));
+            helper[h].start();
+        }
+    }
+
+    void detach() {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (!users || --users) return;
+        for (uint32_t h = 0; h < size; h++)
+            helper[h].stop();
+    }
+
+    // all users share the helpers, so the last call wins
+    void setPriority(int32_t rt_prio, int32_t rt_policy) {
+        std::lock_guard<std::mutex> lk(mutex);
+        for (uint32_t h = 0; h < size; h++)
+            helper[h].setPriority(rt_prio, rt_policy);
+    }
+
+    // get a free helper which is waiting right now, null when all are
+    // busy, never wait for a helper
+    inline ParallelThread* claim() noexcept {
+        for (uint32_t h = 0; h < size; h++) {
+            if (busy[h].load(std::memory_order_relaxed)) {
+                // a retired helper could be taken once it finished the task
+                if (!retired[h].load(std::memory_order_acquire) ||
+                    helper[h].getDone() == doneAt[h].load(std::memory_order_relaxed) ||
+                    !retired[h].exchange(false, std::memory_order_acq_rel)) continue;
+            } else if (busy[h].exchange(true, std::memory_order_acquire)) {
+                continue;
+            }
+            if (helper[h].tryProcess()) {
+                doneAt[h].store(helper[h].getDone(), std::memory_order_relaxed);
+                return &helper[h];
+            }
+            busy[h].store(false, std::memory_order_release);
+        }
+        return nullptr;
+    }
+
+    // give the helper back after processWait()
+    inline void release(ParallelThread* t) noexcept {
+        busy[t - helper].store(false, std::memory_order_release);
+    }
+
+    // give the helper back after a dropped processWait(), it stays
+    // busy until it finished the task
+    inline void retire(ParallelThread* t) noexcept {
+        retired[t - helper].store(true, std::memory_order_release);
+    }
+
+    // the process wide counters of helper h
+    inline const ParallelThreadStats& getStats(uint32_t h) const noexcept {
+        return helper[std::min(h, maxHelpers - 1)].getStats();
+    }
+
+private:
+    ParallelThread helper[maxHelpers];
+    std::atomic<bool> busy[maxHelpers];
+    std::atomic<bool> retired[maxHelpers];
+    // the done count of the helper when it was claimed
+    std::atomic<uint32_t> doneAt[maxHelpers];
+    std::mutex mutex;
+    uint32_t size;
+    uint32_t users;
+    bool isEnabled;
+
+    ForkJoinPool() : size(0), users(0), isEnabled(false) {
+        for (uint32_t h = 0; h < maxHelpers; h++) {
+            busy[h].store(false, std::memory_order_relaxed);
+            retired[h].store(false, std::memory_order_relaxed);
+            doneAt[h].store(0, std::memory_order_relaxed);
+        }
+        const char* p = getenv("RATATOUILLE_POOL");
+        if (!p || !*p) return;
+        if (strcmp(p, "auto") == 0) {
+            size = std::max<uint32_t>(1, std::thread::hardware_concurrency()) - 1;
+        } else {
+            char* end;
+            const long n = strtol(p, &end, 10);
+            if (*end || n < 0) {
+                fprintf(stderr, "ForkJoin: invalid RATATOUILLE_POOL %s, use a number or auto\n", p);
+                return;
+            }
+            // 0 switch the pool off
+            if (!n) return;
+            size = static_cast<uint32_t>(std::min<long>(n, maxHelpers));
+        }
+        size = std::min(size, maxHelpers);
+        // no core left for a helper, the instances run anything inline
+        isEnabled = size > 0;
+    }
+};
+
+class ForkJoin
+{
+public:
+    static const uint32_t maxHelpers = 4;
+    // groups run inline by the adaptive mode before one is handed over anyway
+    static const uint32_t probeBlocks = 64;
+
+    ForkJoin() : helpers(1), pending(0), handed(0), offload(0), pool(nullptr),
+                 attached(false), adaptive(true), handshakeNs(0), forkNs(0), localNs(0),
+                 inlined(0), timeOut(400), traceHere(nullptr) {
+        for (uint32_t t = 0; t < ProcessPtr::maxSlots; t++) {
+            runner[t].jobs = this;
+            runner[t].task = t;
+            runner[t].name = "task";
+            runner[t].ring = nullptr;
+            costNs[t].store(0, std::memory_order_relaxed);
+            offloading[t] = true;
+            traceThere[t] = nullptr;
+        }
+    }
+
+    ~ForkJoin() {
+        stop();
+    }
+
+    // hand the tasks to the process wide pool, call it before start()
+    void useSharedPool(bool use) noexcept {
+        pool = use ? &ForkJoinPool::get() : nullptr;
+    }
+
+    inline bool usesSharedPool() const noexcept {
+        return pool != nullptr;
+    }
+
+    // set the number of helper threads, call it before start()
+    void setHelpers(uint32_t n) noexcept {
+        helpers = std::min(n, maxHelpers);
+    }
+
+    inline uint32_t getHelpers() const noexcept {
+        return helpers;
+    }
+
+    // offload a task only when it shorten the group, default on
+    void setAdaptive(bool on) noexcept {
+        adaptive = on;
+    }
+
+    void start() {
+        if (pool) {
+            if (!attached) pool->attach();
+            attached = true;
+            return;
+        }
+        for (uint32_t h = 0; h < helpers; h++) {
+            helper[h].setAffinity(HelperCpus::get().next());
+            helper[h].start();
+        }
+    }
+
+    void stop() {
+        if (attached) pool->detach();
+        attached = false;
+        for (uint32_t h = 0; h < maxHelpers; h++)
+            helper[h].stop();
+    }
+
+    void setThreadName(std::string name) noexcept {
+        for (uint32_t h = 0; h < maxHelpers; h++)
+            helper[h].setThreadName(h ? name + std::to_string(h) : name);
+    }
+
+    void setPriority(int32_t rt_prio, int32_t rt_policy) {
+        if (pool) pool->setPriority(rt_prio, rt_policy);
+        for (uint32_t h = 0; h < helpers; h++)
+            helper[h].setPriority(rt_prio, rt_policy);
+    }
+
+    // for the own helpers, with the pool the waits of this instance
+    void setTimeOut(uint32_t timeout) noexcept {
+        timeOut.store(timeout, std::memory_order_relaxed);
+        for (uint32_t h = 0; h < maxHelpers; h++)
+            helper[h].setTimeOut(timeout);
+    }
+
+    // only for the own helpers, the pool use its own settings
+    void setSpin(uint32_t spin) noexcept {
+        for (uint32_t h = 0; h < maxHelpers; h++)
+            helper[h].setSpin(spin);
+    }
+
+    // register a task, name is used for the trace and must be a string literal
+    template <uint32_t task, class C, void (C::*Function)()>
+    void set(C* instance, const char* name = "task") noexcept {
+        static_assert(task < ProcessPtr::maxSlots, "ForkJoin: task number out of range");
+        local.set<task, C, Function>(instance);
+        runner[task].name = name;
+    }
+
+    // trace the tasks, each ring is written by one thread at a time:
+    // here the tasks run in the calling thread, there[c] the c-th task
+    // of a group handed to a helper, call it before the first fork()
+    void setTrace(ratatouille::TraceRing* here, ratatouille::TraceRing* const* there,
+                                                            uint32_t n) noexcept {
+        traceHere = here;
+        for (uint32_t c = 0; c < ProcessPtr::maxSlots; c++)
+            traceThere[c] = c < n ? there[c] : nullptr;
+    }
+
+    // start a group of independent tasks
+    inline void fork(const uint32_t* tasks, uint32_t n) noexcept {
+        const int64_t start = now();
+        pending = 0;
+        handed = 0;
+        offload.store(0, std::memory_order_relaxed);
+        n = std::min(n, ProcessPtr::maxSlots);
+        if (!n) return;
+        if (adaptive) tasks = byCost(tasks, n);
+        queue[pending++] = tasks[0];
+        int64_t localCost = getCost(tasks[0]);
+        uint32_t h = 0;
+        // hand over anyway from time to time to measure the hand over again
+        const bool probe = adaptive && inlined >= probeBlocks;
+        bool declined = false;
+        for (uint32_t t = 1; t < n; t++) {
+            ParallelThread* th = nullptr;
+            if (adaptive && !probe && !worthOffload(tasks[t], localCost)) {
+                declined = true;
+            } else {
+                if (pool) {
+                    th = pool->claim();
+                    if (!th) poolStats.count(poolStats.fallbacks);
+                } else {
+                    while (h < helpers && !helper[h].getProcess()) h++;
+                    if (h < helpers) th = &helper[h++];
+                }
+            }
+            if (th) {
+                setOffload(tasks[t]);
+                runner[tasks[t]].ring = traceThere[handed];
+                th->set<0, Runner, &Runner::run>(&runner[tasks[t]]);
+                th->setProcessor(0);
+                th->runProcess();
+                handedTask[handed] = tasks[t];
+                handedTo[handed++] = th;
+            } else {
+                queue[pending++] = tasks[t];
+                localCost += getCost(tasks[t]);
+            }
+        }
+        if (handed) inlined = 0;
+        else if (declined) inlined++;
+        forkNs = now() - start;
+    }
+
+    // run the tasks kept for the calling thread
+    inline void runLocal() noexcept {
+        const int64_t start = now();
+        for (uint32_t t = 0; t < pending; t++) {
+            runner[queue[t]].ring = traceHere;
+            runner[queue[t]].run();
+        }
+        pending = 0;
+        localNs = now() - start;
+    }
+
+    // wait for the tasks handed to the helpers
+    inline void wait() noexcept {
+        if (!handed) return;
+        const int64_t start = now();
+        int64_t remoteCost = 0;
+        for (uint32_t c = 0; c < handed; c++) {
+            if (pool) {
+                if (poolWait(handedTo[c])) pool->release(handedTo[c]);
+                else pool->retire(handedTo[c]);
+            } else {
+                handedTo[c]->processWait();
+            }
+            remoteCost = std::max(remoteCost, getCost(handedTask[c]));
+        }
+        handed = 0;
+        // the hand over is the time the group took longer than
+        // the helpers needed for their tasks
+        const int64_t idle = std::max<int64_t>(0, remoteCost - localNs);
+        const int64_t sample = forkNs + std::max<int64_t>(0, now() - start - idle);
+        handshakeNs += (sample - handshakeNs) / 8;
+    }
+
+    inline void join() noexcept {
+        runLocal();
+        wait();
+    }
+
+    // true when the task of the current group run on a helper thread
+    inline bool isOffloaded(uint32_t task) const noexcept {
+        return offload.load(std::memory_order_relaxed) & (1u << task);
+    }
+
+    // the measured run time of a task, in nanoseconds (smoothed)
+    inline int64_t getCost(uint32_t task) const noexcept {
+        return costNs[task].load(std::memory_order_relaxed);
+    }
+
+    // the measured cost to hand a task to a helper, in nanoseconds (smoothed)
+    inline int64_t getHandshake() const noexcept {
+        return handshakeNs;
+    }
+
+    // the counters of the own helpers, or of the hand overs
+    // of this instance to the pool when shared
+    inline const ParallelThreadStats& getStats(uint32_t h) const noexcept {
+        if (pool) return poolStats;
+        return helper[std::min(h, maxHelpers - 1)].getStats();
+    }
+
+private:
+    // run and time a task, on a helper or in the calling thread
+    struct Runner {
+        ForkJoin* jobs;
+        uint32_t task;
+        const char* name;
+        ratatouille::TraceRing* ring;
+        void run() {
+            ratatouille::TraceScope t(ring, name);
+            const int64_t start = now();
+            jobs->local.process(task);
+            const int64_t cost = jobs->getCost(task);
+            jobs->costNs[task].store(cost + (now() - start - cost) / 8,
+                                            std::memory_order_relaxed);
+        }
+    };
+
+    ParallelThread helper[maxHelpers];
+    ProcessPtr local;
+    Runner runner[ProcessPtr::maxSlots];
+    std::atomic<int64_t> costNs[ProcessPtr::maxSlots];
+    bool offloading[ProcessPtr::maxSlots];
+    ParallelThread* handedTo[ProcessPtr::maxSlots];
+    uint32_t handedTask[ProcessPtr::maxSlots];
+    uint32_t queue[ProcessPtr::maxSlots];
+    uint32_t order[ProcessPtr::maxSlots];
+    uint32_t helpers;
+    uint32_t pending;
+    uint32_t handed;
+    std::atomic<uint32_t> offload;
+    ForkJoinPool* pool;
+    ParallelThreadStats poolStats;
+    bool attached;
+    bool adaptive;
+    int64_t handshakeNs;
+    int64_t forkNs;
+    int64_t localNs;
+    uint32_t inlined;
+    // the time out of the waits on pool helpers in microseconds
+    std::atomic<uint32_t> timeOut;
+    ratatouille::TraceRing* traceHere;
+    ratatouille::TraceRing* traceThere[ProcessPtr::maxSlots];
+
+    // offloading a task save at most the shorter of its own cost and
+    // the cost of the work kept here, it pays off when that is more
+    // than the hand over. Switch back to offloading only when it save
+    // twice the hand over, so the decision don't toggle each block.
+    inline bool worthOffload(uint32_t task, int64_t localCost) noexcept {
+        const int64_t saved = std::min(getCost(task), localCost);
+        offloading[task] = saved >= (offloading[task] ? handshakeNs : 2 * handshakeNs);
+        return offloading[task];
+    }
+
+    // order the group by measured cost, most expensive first, so the
+    // calling thread keep the longest task and the helpers get the
+    // shorter ones. Equal costs keep the given order.
+    inline const uint32_t* byCost(const uint32_t* tasks, uint32_t n) noexcept {
+        for (uint32_t t = 0; t < n; t++) {
+            uint32_t i = t;
+            const int64_t cost = getCost(tasks[t]);
+            for (; i > 0 && getCost(order[i - 1]) < cost; i--)
+                order[i] = order[i - 1];
+            order[i] = tasks[t];
+        }
+        return order;
+    }
+
+    // processWait() on a pool helper with the time out of this instance,
+    // the helper is claimed by this instance, so what its counters
+    // change in between belong to us. Return false when dropped.
+    inline bool poolWait(ParallelThread* th) noexcept {
+        const ParallelThreadStats& s = th->getStats();
+        const uint32_t timeouts = s.timeouts.load(std::memory_order_relaxed);
+        const int64_t start = now();
+        const bool done = th->processWait(timeOut.load(std::memory_order_relaxed));
+        poolStats.waited(now() - start);
+        add(poolStats.timeouts, s.timeouts.load(std::memory_order_relaxed) - timeouts);
+        if (!done) poolStats.count(poolStats.dropped);
+        return done;
+    }
+
+    static inline void add(std::atomic<uint32_t>& c, uint32_t n) noexcept {
+        if (n) c.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    inline void setOffload(uint32_t task) noexcept {
+        offload.store(offload.load(std::memory_order_relaxed) | (1u << task),
+                                                std::memory_order_relaxed);
+    }
+
+    static inline int64_t now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif
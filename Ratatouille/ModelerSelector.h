@@ -24,6 +24,7 @@
 #include "RTNeural.h"
 
 #include "gx_resampler.h"
+#include "RatatouilleProfile.h"
 
 #pragma once
 
@@ -48,8 +49,13 @@ public:
     virtual inline void compute(int count, float *input0, float *output0) {}
     virtual bool loadModel() { return false;}
     virtual void unloadModel() {}
+    // bytes held by the loaded model and its resampler
+    virtual size_t memoryUsage() { return 0;}
+    void setProfile(LoadProfile* profile_) { profile = profile_;}
 
-    ModelerBase() {};
+    LoadProfile* profile;
+
+    ModelerBase() : profile(nullptr) {};
     virtual ~ModelerBase() {};
 };
 
@@ -70,6 +76,7 @@ private:
     int                             needResample;
 
     float                           loudness;
+    size_t                          modelMemory;
 
     bool                            isInited;
     std::mutex                      WMutex;
@@ -87,6 +94,7 @@ public:
     inline void compute(int count, float *input0, float *output0) override;
     bool loadModel() override;
     void unloadModel() override;
+    size_t memoryUsage() override { return modelMemory + smp.memory();}
 
     NeuralModel(std::condition_variable *var);
     ~NeuralModel();
@@ -107,12 +115,15 @@ private:
     int                             fSampleRate;
     int                             modelSampleRate;
     int                             needResample;
+    size_t                          modelMemory;
 
     bool                            isInited;
     std::mutex                      WMutex;
     std::condition_variable*        SyncWait;
 
     void get_samplerate(std::string config_file, int *mSampleRate);
+    static size_t count_weights(const nlohmann::json& config);
+    static size_t count_numbers(const nlohmann::json& value);
 
 public:
     std::string                     modelFile;
@@ -125,6 +136,7 @@ public:
     inline void compute(int count, float *input0, float *output0) override;
     bool loadModel() override;
     void unloadModel() override;
+    size_t memoryUsage() override { return modelMemory + smp.memory();}
 
     RtNeuralModel(std::condition_variable *var);
     ~RtNeuralModel();
@@ -140,6 +152,8 @@ public:
 
     void setModelFile(std::string modelFile_) {
             if (needNewModeler(modelFile_)) {
+                // release the model of the former file type
+                modeler->unloadModel();
                 selectModeler();
                 modeler->init(sampleRate);
             }
@@ -167,6 +181,14 @@ public:
     void unloadModel() {
             return modeler->unloadModel();}
 
+    // both modelers, to catch a model left in the inactive one
+    size_t memoryUsage() {
+            return namModel.memoryUsage() + rtnModel.memoryUsage();}
+
+    void setProfile(LoadProfile* profile) {
+            namModel.setProfile(profile);
+            rtnModel.setProfile(profile);}
+
     ModelerSelector(std::condition_variable *var) :
             noModel(),
             namModel(var),
@@ -16,6 +16,7 @@ NeuralModel::NeuralModel(std::condition_variable *Sync)
     : model(nullptr), smp(), SyncWait(Sync) {
     nam::activations::Activation::enable_fast_tanh();
     loudness = 0.0;
+    modelMemory = 0;
     nGain = 1.0;
     needResample = 0;
     isInited = false;
@@ -101,15 +102,25 @@ bool NeuralModel::loadModel() {
        // fprintf(stderr, "Load file %s\n", modelFile.c_str());
         std::unique_lock<std::mutex> lk(WMutex);
         ready.store(false, std::memory_order_release);
-        SyncWait->wait(lk);
+        {
+            PhaseTimer t(profile, PHASE_SYNC);
+            SyncWait->wait(lk);
+        }
         delete model;
        // fprintf(stderr, "delete model\n");
         model = nullptr;
         needResample = 0;
+        modelMemory = 0;
+        smp.clear();
         //clearState();
         int32_t warmUpSize = 4096;
         try {
-            model = nam::get_dsp(std::string(modelFile)).release();
+            // nam::get_dsp() read and parse the file in one go,
+            // the returned config tell us the size of the weights
+            PhaseTimer t(profile, PHASE_PARSE);
+            nam::dspData config;
+            model = nam::get_dsp(std::string(modelFile), config).release();
+            modelMemory = config.weights.size() * sizeof(float);
         } catch (const std::exception&) {
             modelFile = "None";
         }
@@ -125,13 +136,17 @@ bool NeuralModel::loadModel() {
             modelSampleRate = static_cast<int>(model->GetExpectedSampleRate());
             //model->SetLoudness(-15.0);
             if (modelSampleRate <= 0) modelSampleRate = 48000;
-            if (modelSampleRate > fSampleRate) {
-                smp.setup(fSampleRate, modelSampleRate);
-                needResample = 1;
-            } else if (modelSampleRate < fSampleRate) {
-                smp.setup(modelSampleRate, fSampleRate);
-                needResample = 2;
-            } 
+            {
+                PhaseTimer t(profile, PHASE_RESAMPLE);
+                if (modelSampleRate > fSampleRate) {
+                    smp.setup(fSampleRate, modelSampleRate);
+                    needResample = 1;
+                } else if (modelSampleRate < fSampleRate) {
+                    smp.setup(modelSampleRate, fSampleRate);
+                    needResample = 2;
+                } 
+            }
+            PhaseTimer t(profile, PHASE_WARMUP);
             float* buffer = new float[warmUpSize];
             memset(buffer, 0, warmUpSize * sizeof(float));
 
@@ -156,6 +171,8 @@ void NeuralModel::unloadModel() {
    // fprintf(stderr, "delete model\n");
     model = nullptr;
     needResample = 0;
+    modelMemory = 0;
+    smp.clear();
     //clearState();
     modelFile = "None";
     ready.store(true, std::memory_order_release);
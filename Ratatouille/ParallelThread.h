@@ -27,6 +27,14 @@
  *      proc.setThreadName("YourName");
  *      // optional set the scheduling class and the priority (as int32_t)
  *      proc.setPriority(priority, scheduling_class)
+ *      // optional pin the thread to a core, -1 (default) allow all cores.
+ *         Kept over stop() and start(), only supported on linux.
+ *      proc.setAffinity(core);
+ *      // optional set how long getProcess() and processWait() spin
+ *         on the thread state before they sleep, in nanoseconds.
+ *         Default is 2000 on multi core systems and 0 (no spin) on
+ *         single core systems.
+ *      proc.setSpin(nanoseconds);
  *      // optional set the timeout value for the waiting functions
  *         in microseconds. Default is 400 micro seconds.
  *         This is a safety guard to avoid dead looks.
@@ -36,6 +44,10 @@
  *      // set the function to run in the parallel thread
  *         function should be defined in YourClass as void YourFunction();
  *      proc.set<YourClass, &YourClass::YourFunction>(*this);
+ *      // or register up to ProcessPtr::maxSlots functions
+ *         and select the one to run with setProcessor(slot)
+ *      proc.set<slot, YourClass, &YourClass::YourFunction>(*this);
+ *      proc.setProcessor(slot);
  *      // now anything is setup to run the thread,
  *         so try to get the processing pointer by getProcess()
  *         getProcess() check if the thread is in waiting state, if not,
@@ -55,15 +67,42 @@
  *         process isn't ready in that time, the data is lost and 
  *         processWait() break to avoid Xruns or dead looks. 
  *         That is the worst case and shouldn't happen 
- *         under normal circumstances.
+ *         under normal circumstances. It return false then.
+ *      // or wait with a timeout of the caller instead of the own one,
+ *         when several callers with different block sizes share the thread
+ *      proc.processWait(microseconds);
+ *      // optional claim the thread only when it's waiting right now,
+ *         never wait for it, return false when it's busy
+ *      if (proc.tryProcess()) proc.runProcess() else functionToRun();
+ *      // the count of functions the thread finished, a dropped function
+ *         is finished when it changed
+ *      uint32_t done = proc.getDone();
+ *      // optional read the counters of the worst case paths,
+ *         could be done from any thread without locking
+ *      const ParallelThreadStats& s = proc.getStats();
+ *         s.fallbacks   getProcess() fail, the function run in the main thread
+ *         s.timeouts    expired waits in getProcess() and processWait()
+ *         s.dropped     processWait() break, the processed data is lost
+ *         s.maxWaitNs   the longest time getProcess() or processWait() waited
  *      // Finally stop the thread before exit.
  *      proc.stop(); 
+ *
+ *  On linux getProcess() and processWait() spin a short time on the
+ *  thread state and then sleep on a futex with a absolute deadline,
+ *  the thread only wake them with a syscall when one sleeps.
+ *  Other systems use a pthread condition variable instead.
+ *  runProcess() never wait for the thread, it don't need the thread to
+ *  get the CPU before it return. With c++17 on linux the thread sleep on
+ *  a futex word, on other systems runProcess() may spin a short time
+ *  while the thread is on the way to sleep, and take the work back and
+ *  run it itself when the thread don't get there within the time out.
  */
 
 #if defined(_WIN32)
 #define MINGW_STDTHREAD_REDUNDANCY_WARNING
 #endif
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <unistd.h>
@@ -75,6 +114,15 @@
 
 #include <pthread.h>
 
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#define PARALLEL_THREAD_FUTEX
+#endif
+
 #pragma once
 
 #ifndef PARALLEL_THREAD_H_
@@ -83,9 +131,12 @@
 class ProcessPtr
 { 
 public:
+    // number of functions which could be registered by set<slot, ...>()
+    static const uint32_t maxSlots = 8;
+
     ProcessPtr() {
-      set<0, ProcessPtr, &ProcessPtr::dummyFunc>(this);
-      set<1, ProcessPtr, &ProcessPtr::dummyFunc>(this);
+      for (i = 0; i < maxSlots; i++)
+          set<ProcessPtr, &ProcessPtr::dummyFunc>(this);
       i = 0;
       }
  
@@ -109,6 +160,11 @@ public:
         return memberFunc[i](instPtr[i]);
     }
 
+    // run the function of a slot without selecting it
+    void process(uint32_t s) const {
+        return memberFunc[s](instPtr[s]);
+    }
+
     void dummyFunc() {}
  
 private:
@@ -120,11 +176,33 @@ private:
         return (static_cast<C*>(instance)->*Function)();
     }
 
-    InstancePtr instPtr[2];
-    MemberFunc memberFunc[2];
+    InstancePtr instPtr[maxSlots];
+    MemberFunc memberFunc[maxSlots];
     uint32_t i;
 };
 
+// counters of the worst case paths, written by the calling threads,
+// more then one when the thread is shared
+struct ParallelThreadStats
+{
+    std::atomic<uint32_t> fallbacks;
+    std::atomic<uint32_t> timeouts;
+    std::atomic<uint32_t> dropped;
+    std::atomic<int64_t>  maxWaitNs;
+
+    ParallelThreadStats() : fallbacks(0), timeouts(0), dropped(0), maxWaitNs(0) {}
+
+    inline void count(std::atomic<uint32_t>& c) noexcept {
+        c.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void waited(int64_t ns) noexcept {
+        int64_t max = maxWaitNs.load(std::memory_order_relaxed);
+        while (ns > max && !maxWaitNs.compare_exchange_weak(max, ns,
+                                        std::memory_order_relaxed)) {}
+    }
+};
+
 class ParallelThread: public ProcessPtr
 {
 public:
@@ -135,9 +213,21 @@ public:
          ,isWaiting(false)
          #if __cplusplus > 201703L
          ,pWorkCond(false)
+         #elif defined(PARALLEL_THREAD_FUTEX)
+         ,pWork(0)
+         #else
+         ,pWork(false)
+         #endif
+         #if defined(PARALLEL_THREAD_FUTEX)
+         ,pProcSeq(0)
+         ,pSleepers(0)
          #endif
+         ,cpuCore(-1)
     {
-        timeoutPeriod = 400;
+        timeoutPeriod.store(400, std::memory_order_relaxed);
+        pDone.store(0, std::memory_order_relaxed);
+        spinPeriod.store(std::thread::hardware_concurrency() > 1 ? 2000 : 0,
+                                                std::memory_order_relaxed);
         threadName = "anonymous";
         init();
     }
@@ -171,60 +261,130 @@ public:
             setThreadPolicy(rt_prio, rt_policy);
     }
 
+    // pin the thread to a core, -1 allow all cores, this may fail silent
+    void setAffinity(int32_t cpu) noexcept {
+        cpuCore = cpu;
+        if (isRunning())
+            setThreadAffinity();
+    }
+
     // set the time out for the thread waiting functions in milliseconds 
     void setTimeOut(uint32_t timeout) noexcept {
-        timeoutPeriod = timeout;
+        timeoutPeriod.store(timeout, std::memory_order_relaxed);
+    }
+
+    // set the time to spin before the waiting functions sleep in nanoseconds
+    void setSpin(uint32_t spin) noexcept {
+        spinPeriod.store(spin, std::memory_order_relaxed);
+    }
+
+    // get the counters of the worst case paths
+    inline const ParallelThreadStats& getStats() const noexcept {
+        return stats;
     }
 
     // try to get the process pointer, return false when thread is busy 
     inline bool getProcess() noexcept {
         if (isRunning() && !getState()) {
+            const int64_t start = now();
             int maxDuration = 0;
+            const uint32_t timeout = timeoutPeriod.load(std::memory_order_relaxed);
             while (!getState()) {
-                pthread_mutex_lock(&pWaitProc);
-                if (pthread_cond_timedwait(&pProcCond, &pWaitProc, getTimeOut()) == ETIMEDOUT) {
-                    pthread_mutex_unlock(&pWaitProc);
+                if (!waitState(&ParallelThread::getState, timeout)) {
+                    stats.count(stats.timeouts);
                     maxDuration +=1;
                     if (maxDuration > 2) {
                         break;
                     }
-                } else {
-                    pthread_mutex_unlock(&pWaitProc);;
                 }
             }
+            stats.waited(now() - start);
         }
-        if (getState()) pWait.store(true, std::memory_order_release);
-        return getState();
+        // read the state once, it may change in between
+        const bool ready = getState();
+        if (ready) pWait.store(true, std::memory_order_release);
+        else if (isRunning()) stats.count(stats.fallbacks);
+        return ready;
+    }
+
+    // get the process pointer only when the thread is waiting,
+    // never wait for it and don't count a fallback
+    inline bool tryProcess() noexcept {
+        if (!isRunning() || !getState()) return false;
+        pWait.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // the count of functions the thread finished
+    inline uint32_t getDone() const noexcept {
+        return pDone.load(std::memory_order_acquire);
     }
 
     // notify the thread that work is to be done
     inline void runProcess() noexcept {
         #if __cplusplus > 201703L
         pWorkCond.store(true);
-        #endif
         pWorkCond.notify_one();
+        #elif defined(PARALLEL_THREAD_FUTEX)
+        // the thread take the work word in any state, no lock needed
+        pWork.store(1, std::memory_order_release);
+        syscall(SYS_futex, &pWork, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, nullptr, nullptr, 0);
+        #else
+        // publish the work without blocking. The thread hold pWaitWork
+        // until it sleeps in wait(), so when the lock could be taken
+        // the notification can't get lost. Else the thread is on the
+        // way to wait() and will see pWork there, spin until then,
+        // or until it took the work already. A thread with lower
+        // priority on the same core may never get there, so after
+        // the time out take the work back and run it here.
+        pWork.store(true, std::memory_order_release);
+        const int64_t end = now() + timeoutPeriod.load(std::memory_order_relaxed) * 1000;
+        bool locked = false;
+        for (uint32_t i = 1; pWork.load(std::memory_order_acquire) &&
+                                    !(locked = pWaitWork.try_lock()); i++) {
+            cpuRelax();
+            if (!(i & 63) && now() >= end) {
+                if (pWork.exchange(false, std::memory_order_acq_rel)) {
+                    stats.count(stats.fallbacks);
+                    process();
+                    pWait.store(false, std::memory_order_release);
+                }
+                return;
+            }
+        }
+        if (locked) pWaitWork.unlock();
+        pWorkCond.notify_one();
+        #endif
     }
 
     // wait for the processed data from the thread, 
     // in worst case this may fail silent
     // when to much time expires (5 * timeOut time)
-    // to avoid Xruns or dead looks.
-    inline void processWait() noexcept {
-        if (isRunning()) {
+    // to avoid Xruns or dead looks, return false then.
+    inline bool processWait() noexcept {
+        return processWait(timeoutPeriod.load(std::memory_order_relaxed));
+    }
+
+    // the same with the given timeout in microseconds
+    inline bool processWait(uint32_t timeout) noexcept {
+        bool ret = true;
+        if (isRunning() && pWait.load(std::memory_order_acquire)) {
+            const int64_t start = now();
             int maxDuration = 0;
             while (pWait.load(std::memory_order_acquire)) {
-                pthread_mutex_lock(&pWaitProc);
-                if (pthread_cond_timedwait(&pProcCond, &pWaitProc, getTimeOut()) == ETIMEDOUT) {
-                    pthread_mutex_unlock(&pWaitProc);
+                if (!waitState(&ParallelThread::isDone, timeout)) {
+                    stats.count(stats.timeouts);
                     maxDuration +=1;
                     if (maxDuration > 5) {
                         pWait.store(false, std::memory_order_release);
+                        stats.count(stats.dropped);
+                        ret = false;
                     }
-                } else {
-                    pthread_mutex_unlock(&pWaitProc);;
                 }
             }
+            stats.waited(now() - start);
         }
+        return ret;
     }
 
     // stop the thread (at least on Destruction)
@@ -233,10 +393,15 @@ public:
             pRun.store(false, std::memory_order_release);
             if (pThd.joinable()) {
                 set<ProcessPtr, &ProcessPtr::dummyFunc>(this);
-                #if __cplusplus > 201703L
-                pWorkCond.store(true);
+                #if __cplusplus > 201703L || defined(PARALLEL_THREAD_FUTEX)
+                runProcess();
+                #else
+                {
+                    std::lock_guard<std::mutex> lk(pWaitWork);
+                    pWork.store(true, std::memory_order_release);
+                    pWorkCond.notify_one();
+                }
                 #endif
-                pWorkCond.notify_one();
                 pThd.join();
             }
         }
@@ -250,18 +415,36 @@ private:
 
     #if __cplusplus > 201703L
     std::atomic<bool> pWorkCond;
+    #elif defined(PARALLEL_THREAD_FUTEX)
+    // futex word, 1 when work is to be done
+    std::atomic<uint32_t> pWork;
     #else
+    std::atomic<bool> pWork;
     std::mutex pWaitWork;
     std::condition_variable pWorkCond;
     #endif
 
     std::thread pThd;
     std::string threadName;
-    uint32_t timeoutPeriod;
+    ParallelThreadStats stats;
+    // could be set from another thread while the waiting functions run
+    std::atomic<uint32_t> timeoutPeriod;
+    std::atomic<uint32_t> spinPeriod;
+    // incremented by the thread after each function
+    std::atomic<uint32_t> pDone;
+
+    #if defined(PARALLEL_THREAD_FUTEX)
+    // incremented by the thread on each change of isWaiting,
+    // the futex word the waiting functions sleep on
+    std::atomic<uint32_t> pProcSeq;
+    // waiting functions sleeping on pProcSeq
+    std::atomic<uint32_t> pSleepers;
+    #endif
 
     pthread_mutex_t pWaitProc;
     pthread_cond_t pProcCond;
     struct timespec timeOut;
+    int32_t cpuCore;
 
     // init pthread_cond_t and pthread_mutex_t
     inline void init() noexcept {
@@ -280,26 +463,33 @@ private:
         };
         pRun.store(true, std::memory_order_release);
         pThd = std::thread([this]() {
-            #if __cplusplus <= 201703L
+            #if __cplusplus <= 201703L && !defined(PARALLEL_THREAD_FUTEX)
             std::unique_lock<std::mutex> lk(pWaitWork);
             #endif
             while (pRun.load(std::memory_order_acquire)) {
                 isWaiting.store(true, std::memory_order_release);
-                pthread_cond_broadcast(&pProcCond);
+                wakeWaiters();
                 // wait for signal from parent thread that work is to do
                 #if __cplusplus > 201703L
                 pWorkCond.wait(false);
                 pWorkCond.store(false);
+                #elif defined(PARALLEL_THREAD_FUTEX)
+                while (!pWork.exchange(0, std::memory_order_acq_rel))
+                    syscall(SYS_futex, &pWork, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 0, nullptr, nullptr, 0);
                 #else
-                pWorkCond.wait(lk);
+                // take the work with exchange, runProcess() may take it back
+                pWorkCond.wait(lk, [this]() {
+                    return pWork.exchange(false, std::memory_order_acq_rel); });
                 #endif
                 isWaiting.store(false, std::memory_order_release);
                 pWait.store(true, std::memory_order_release);
                 process();
+                pDone.fetch_add(1, std::memory_order_release);
                 pWait.store(false, std::memory_order_release);
             }
             // when done
         });    
+        if (cpuCore >= 0) setThreadAffinity();
     }
 
     // check if thread is busy, return true when not
@@ -307,6 +497,69 @@ private:
         return isWaiting.load(std::memory_order_acquire);
     }
 
+    // check if the processed data is ready
+    inline bool isDone() const noexcept {
+        return !pWait.load(std::memory_order_acquire);
+    }
+
+    inline void cpuRelax() const noexcept {
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+        #endif
+    }
+
+    // wait until (this->*ready)() or the timeout expires,
+    // return false when the timeout expires
+    inline bool waitState(bool (ParallelThread::*ready)() const noexcept,
+                                                uint32_t timeout) noexcept {
+        const uint32_t spin = spinPeriod.load(std::memory_order_relaxed);
+        if (spin) {
+            const int64_t spinEnd = now() + spin;
+            for (uint32_t i = 1; ; i++) {
+                if ((this->*ready)()) return true;
+                cpuRelax();
+                if (!(i & 63) && now() >= spinEnd) break;
+            }
+        }
+        #if defined(PARALLEL_THREAD_FUTEX)
+        const struct timespec* deadline = getTimeOut(timeout);
+        bool ret = true;
+        pSleepers.fetch_add(1, std::memory_order_seq_cst);
+        while (true) {
+            // read the sequence before the state, a change in between
+            // let the futex return directly
+            const uint32_t seq = pProcSeq.load(std::memory_order_seq_cst);
+            if ((this->*ready)()) break;
+            if (syscall(SYS_futex, &pProcSeq, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                        seq, deadline, nullptr, FUTEX_BITSET_MATCH_ANY) == -1 &&
+                        errno == ETIMEDOUT) {
+                ret = (this->*ready)();
+                break;
+            }
+        }
+        pSleepers.fetch_sub(1, std::memory_order_relaxed);
+        return ret;
+        #else
+        pthread_mutex_lock(&pWaitProc);
+        const bool ret = pthread_cond_timedwait(&pProcCond, &pWaitProc, getTimeOut(timeout)) != ETIMEDOUT;
+        pthread_mutex_unlock(&pWaitProc);
+        return ret;
+        #endif
+    }
+
+    // called from the thread when the state change
+    inline void wakeWaiters() noexcept {
+        #if defined(PARALLEL_THREAD_FUTEX)
+        pProcSeq.fetch_add(1, std::memory_order_seq_cst);
+        if (pSleepers.load(std::memory_order_seq_cst))
+            syscall(SYS_futex, &pProcSeq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, nullptr, nullptr, 0);
+        #else
+        pthread_cond_broadcast(&pProcCond);
+        #endif
+    }
+
     // set thread scheduling class and priority level 
     inline void setThreadPolicy(int32_t rt_prio, int32_t rt_policy) noexcept {
         #if defined(__linux__) || defined(_UNIX) || defined(__APPLE__) || defined(_OS_UNIX_)
@@ -329,10 +582,37 @@ private:
         #endif
     }
 
+    // pin the thread to cpuCore, or allow all cores again
+    inline void setThreadAffinity() noexcept {
+        #if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (cpuCore >= 0 && cpuCore < CPU_SETSIZE) {
+            CPU_SET(cpuCore, &set);
+        } else {
+            const int n = std::min<int>(CPU_SETSIZE, sysconf(_SC_NPROCESSORS_CONF));
+            for (int i = 0; i < n; i++) CPU_SET(i, &set);
+        }
+        if (pthread_setaffinity_np(pThd.native_handle(), sizeof(set), &set)) {
+            fprintf(stderr, "ParallelThread:%s fail to set affinity to core %i\n",
+                                                threadName.c_str(), cpuCore);
+        }
+        #else
+        //system does not supports thread affinity!
+        #endif
+    }
+
+    // monotonic time in nanoseconds
+    inline int64_t now() noexcept {
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000LL + t.tv_nsec;
+    }
+
     // calculate the timeout for the thread wait functions
-    inline struct timespec *getTimeOut() noexcept {
+    inline struct timespec *getTimeOut(uint32_t timeout) noexcept {
         clock_gettime (CLOCK_MONOTONIC, &timeOut);
-        long int at = (timeoutPeriod * 1000);
+        long int at = (timeout * 1000L);
         if (timeOut.tv_nsec + at > 1000000000) {
             timeOut.tv_sec +=1;
             at -= 1000000000;
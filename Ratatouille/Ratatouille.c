@@ -24,6 +24,58 @@
 #define XLV2__neural_model1 "urn:brummer:ratatouille#Neural_Model1"
 #define XLV2__IRFILE "urn:brummer:ratatouille#irfile"
 #define XLV2__IRFILE1 "urn:brummer:ratatouille#irfile1"
+#define XLV2__LOAD_EVENT "urn:brummer:ratatouille#loadEvent"
+#define XLV2__LOAD_SLOT "urn:brummer:ratatouille#loadSlot"
+#define XLV2__LOAD_STAGE "urn:brummer:ratatouille#loadStage"
+#define XLV2__LOAD_TIME "urn:brummer:ratatouille#loadTime"
+#define XLV2__DSP_PROFILE "urn:brummer:ratatouille#dspProfile"
+#define XLV2__DSP_BLOCKS "urn:brummer:ratatouille#dspBlocks"
+#define XLV2__DSP_MEAN "urn:brummer:ratatouille#dspMean"
+#define XLV2__DSP_MAX "urn:brummer:ratatouille#dspMax"
+#define XLV2__DSP_MISSES "urn:brummer:ratatouille#dspMisses"
+#define XLV2__DSP_BUDGET "urn:brummer:ratatouille#dspBudget"
+#define XLV2__DSP_PARALLEL "urn:brummer:ratatouille#dspParallel"
+#define XLV2__THREAD_STATS "urn:brummer:ratatouille#threadStats"
+#define XLV2__THREAD "urn:brummer:ratatouille#thread"
+#define XLV2__FALLBACKS "urn:brummer:ratatouille#fallbacks"
+#define XLV2__TIMEOUTS "urn:brummer:ratatouille#timeouts"
+#define XLV2__DROPPED "urn:brummer:ratatouille#dropped"
+
+// load stages posted by the plugin, see LoadStage in RatatouilleProfile.h
+enum {
+    LOAD_QUEUED,
+    LOAD_READING,
+    LOAD_PARSING,
+    LOAD_RESAMPLING,
+    LOAD_WARMUP,
+    LOAD_PARTITIONING,
+    LOAD_SWAPPED,
+    LOAD_FAILED,
+    LOAD_STAGE_COUNT
+};
+
+static const char* load_stage_names[LOAD_STAGE_COUNT] = {
+    "queued", "reading", "parsing", "resampling", "warming up", "partitioning", "swapped in", "failed"
+};
+
+// stages of run() posted by the plugin, see DspStage in RatatouilleProfile.h
+enum {
+    STAGE_DELAY,
+    STAGE_INPUT,
+    STAGE_MODELS_LOCAL,
+    STAGE_MODELS_WAIT,
+    STAGE_BLEND,
+    STAGE_DCBLOCKER,
+    STAGE_CONVS_LOCAL,
+    STAGE_CONVS_WAIT,
+    STAGE_MIX,
+    STAGE_COUNT
+};
+
+// windows (about a second each) to sum the deadline misses over
+#define PERF_RECENT 10
+// ui_idle calls between two redraws of the overlay
+#define PERF_IDLE_RATE 15
 
 #define OBJ_BUF_SIZE 1024
 
@@ -33,6 +85,22 @@ typedef struct {
     LV2_URID neural_model1;
     LV2_URID conv_ir_file;
     LV2_URID conv_ir_file1;
+    LV2_URID load_event;
+    LV2_URID load_slot;
+    LV2_URID load_stage;
+    LV2_URID load_time;
+    LV2_URID dsp_profile;
+    LV2_URID dsp_blocks;
+    LV2_URID dsp_mean;
+    LV2_URID dsp_max;
+    LV2_URID dsp_misses;
+    LV2_URID dsp_budget;
+    LV2_URID dsp_parallel;
+    LV2_URID thread_stats;
+    LV2_URID thread;
+    LV2_URID fallbacks;
+    LV2_URID timeouts;
+    LV2_URID dropped;
     LV2_URID atom_Object;
     LV2_URID atom_Int;
     LV2_URID atom_Float;
@@ -55,8 +123,27 @@ typedef struct {
     FilePicker *filepicker;
     char *filename;
     char *dir_name;
+    char status[64];
+    float loadMs;
 } ModelPicker;
 
+typedef struct {
+    float meanUs[STAGE_COUNT];
+    float maxUs[STAGE_COUNT];
+    float budgetUs;
+    float efficiency;
+    int misses[PERF_RECENT];
+    int window;
+    uint32_t fallbacks;
+    uint32_t timeouts;
+    uint32_t dropped;
+    int valid;
+    int dirty;
+    int idle;
+    int alarm;
+    char line[2][160];
+} PerfOverlay;
+
 typedef struct {
     LV2_Atom_Forge forge;
     X11LV2URIs   uris;
@@ -64,6 +151,7 @@ typedef struct {
     ModelPicker mb;
     ModelPicker ir;
     ModelPicker ir1;
+    PerfOverlay perf;
     char *fname;
 } X11_UI_Private_t;
 
@@ -72,6 +160,22 @@ static inline void map_x11ui_uris(LV2_URID_Map* map, X11LV2URIs* uris) {
     uris->neural_model1 = map->map(map->handle, XLV2__neural_model1);
     uris->conv_ir_file = map->map(map->handle, XLV2__IRFILE);
     uris->conv_ir_file1 = map->map(map->handle, XLV2__IRFILE1);
+    uris->load_event = map->map(map->handle, XLV2__LOAD_EVENT);
+    uris->load_slot = map->map(map->handle, XLV2__LOAD_SLOT);
+    uris->load_stage = map->map(map->handle, XLV2__LOAD_STAGE);
+    uris->load_time = map->map(map->handle, XLV2__LOAD_TIME);
+    uris->dsp_profile = map->map(map->handle, XLV2__DSP_PROFILE);
+    uris->dsp_blocks = map->map(map->handle, XLV2__DSP_BLOCKS);
+    uris->dsp_mean = map->map(map->handle, XLV2__DSP_MEAN);
+    uris->dsp_max = map->map(map->handle, XLV2__DSP_MAX);
+    uris->dsp_misses = map->map(map->handle, XLV2__DSP_MISSES);
+    uris->dsp_budget = map->map(map->handle, XLV2__DSP_BUDGET);
+    uris->dsp_parallel = map->map(map->handle, XLV2__DSP_PARALLEL);
+    uris->thread_stats = map->map(map->handle, XLV2__THREAD_STATS);
+    uris->thread = map->map(map->handle, XLV2__THREAD);
+    uris->fallbacks = map->map(map->handle, XLV2__FALLBACKS);
+    uris->timeouts = map->map(map->handle, XLV2__TIMEOUTS);
+    uris->dropped = map->map(map->handle, XLV2__DROPPED);
     uris->atom_Object = map->map(map->handle, LV2_ATOM__Object);
     uris->atom_Int = map->map(map->handle, LV2_ATOM__Int);
     uris->atom_Float = map->map(map->handle, LV2_ATOM__Float);
@@ -197,6 +301,8 @@ static void file_load_response(void *w_, void* user_data) {
         free(m->filename);
         m->filename = NULL;
         m->filename = strdup(*(const char**)user_data);
+        m->status[0] = '\0';
+        m->loadMs = 0.0;
         LV2_URID urid;
         if ((strcmp(m->filename, "None") == 0)) {
             if (old) {
@@ -242,6 +348,40 @@ void first_loop(X11_UI *ui) {
     notify_dsp(ui);
 }
 
+// format the overlay text here, at most every PERF_IDLE_RATE calls,
+// so draw_window only show two strings
+void plugin_idle(X11_UI *ui) {
+    X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+    PerfOverlay *p = &ps->perf;
+    if (p->idle > 0) p->idle--;
+    if (!p->dirty || p->idle) return;
+    p->dirty = 0;
+    p->idle = PERF_IDLE_RATE;
+    float blockUs = 0.0;
+    int i = 0;
+    for (;i<STAGE_COUNT;i++) blockUs += p->meanUs[i];
+    const float otherUs = blockUs - p->meanUs[STAGE_MODELS_LOCAL] - p->meanUs[STAGE_MODELS_WAIT] -
+                        p->meanUs[STAGE_CONVS_LOCAL] - p->meanUs[STAGE_CONVS_WAIT];
+    int recent = 0;
+    for (i=0;i<PERF_RECENT;i++) recent += p->misses[i];
+    char parallel[16];
+    if (p->efficiency < 0.0) snprintf(parallel, sizeof(parallel), "--");
+    else snprintf(parallel, sizeof(parallel), "%i%%", (int)(p->efficiency * 100.0 + 0.5));
+    snprintf(p->line[0], sizeof(p->line[0]),
+        "ms: models %.2f  wait %.2f  convs %.2f  wait %.2f  other %.2f  max models %.2f convs %.2f",
+        p->meanUs[STAGE_MODELS_LOCAL] * 0.001, p->meanUs[STAGE_MODELS_WAIT] * 0.001,
+        p->meanUs[STAGE_CONVS_LOCAL] * 0.001, p->meanUs[STAGE_CONVS_WAIT] * 0.001, otherUs * 0.001,
+        p->maxUs[STAGE_MODELS_LOCAL] * 0.001, p->maxUs[STAGE_CONVS_LOCAL] * 0.001);
+    snprintf(p->line[1], sizeof(p->line[1]),
+        "block %.2f/%.2f ms %i%%  parallel %s  misses %i/%is  pro fallback %u timeout %u drop %u",
+        blockUs * 0.001, p->budgetUs * 0.001,
+        p->budgetUs > 0.0 ? (int)(blockUs * 100.0 / p->budgetUs + 0.5) : 0,
+        parallel, recent, PERF_RECENT, p->fallbacks, p->timeouts, p->dropped);
+    p->alarm = recent > 0 || (p->budgetUs > 0.0 && blockUs > p->budgetUs * 0.8);
+    p->valid = 1;
+    expose_widget(ui->win);
+}
+
 static void file_menu_callback(void *w_, void* user_data) {
     Widget_t *w = (Widget_t*)w_;
     ModelPicker* m = (ModelPicker*) w->parent_struct;
@@ -307,6 +447,16 @@ void plugin_create_controller_widgets(X11_UI *ui, const char * plugin_uri) {
     ps->mb.dir_name = NULL;
     ps->ir.dir_name = NULL;
     ps->ir1.dir_name = NULL;
+    ps->ma.status[0] = '\0';
+    ps->mb.status[0] = '\0';
+    ps->ir.status[0] = '\0';
+    ps->ir1.status[0] = '\0';
+    ps->ma.loadMs = 0.0;
+    ps->mb.loadMs = 0.0;
+    ps->ir.loadMs = 0.0;
+    ps->ir1.loadMs = 0.0;
+    memset(&ps->perf, 0, sizeof(PerfOverlay));
+    ps->perf.efficiency = -1.0;
     ps->fname = NULL;
     ps->ma.filepicker = (FilePicker*)malloc(sizeof(FilePicker));
     fp_init(ps->ma.filepicker, "/");
@@ -469,6 +619,10 @@ static inline void get_file(const LV2_Atom* file_uri, X11_UI* ui, ModelPicker *m
             free(m->filename);
             m->filename = NULL;
             m->filename = strdup(uri);
+            if (m->loadMs > 0.0) {
+                fprintf(stderr, "Ratatouille: %s loaded in %.1f ms\n", basename(m->filename), m->loadMs);
+                m->loadMs = 0.0;
+            }
             char *dn = strdup(dirname((char*)uri));
             if (m->dir_name == NULL || strcmp((const char*)m->dir_name,
                                                     (const char*)dn) !=0) {
@@ -486,10 +640,106 @@ static inline void get_file(const LV2_Atom* file_uri, X11_UI* ui, ModelPicker *m
         free(m->filename);
         m->filename = NULL;
         m->filename = strdup("None");
+        m->loadMs = 0.0;
         expose_widget(ui->win);
     }
 }
 
+static inline void read_load_event(const X11LV2URIs* uris, X11_UI *ui,
+                                    const LV2_Atom_Object* obj) {
+    X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+    const LV2_Atom* slot = NULL;
+    const LV2_Atom* stage = NULL;
+    const LV2_Atom* time = NULL;
+    lv2_atom_object_get(obj, uris->load_slot, &slot, uris->load_stage, &stage,
+                                            uris->load_time, &time, 0);
+    if (!slot || !stage || !time || slot->type != uris->atom_Int ||
+        stage->type != uris->atom_Int || time->type != uris->atom_Float) {
+        return;
+    }
+    ModelPicker *m = NULL;
+    switch (((LV2_Atom_Int*)slot)->body) {
+        case 0: m = &ps->ma; break;
+        case 1: m = &ps->mb; break;
+        case 2: m = &ps->ir; break;
+        case 3: m = &ps->ir1; break;
+        default: return; // restore all, the slots report one by one
+    }
+    const int s = ((LV2_Atom_Int*)stage)->body;
+    const float ms = ((LV2_Atom_Float*)time)->body;
+    if (s < 0 || s >= LOAD_STAGE_COUNT) return;
+    if (s == LOAD_SWAPPED) {
+        m->status[0] = '\0';
+        m->loadMs = ms;
+    } else if (s == LOAD_FAILED) {
+        snprintf(m->status, sizeof(m->status), "failed after %.1f ms", ms);
+        fprintf(stderr, "Ratatouille: load failed after %.1f ms\n", ms);
+    } else {
+        snprintf(m->status, sizeof(m->status), "%s %.1f ms", load_stage_names[s], ms);
+    }
+    expose_widget(ui->win);
+}
+
+static inline int read_float_vector(const X11LV2URIs* uris, const LV2_Atom* a, float *dst, int n) {
+    if (!a || a->type != uris->atom_Vector) return 0;
+    const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)a;
+    if (vec->body.child_type != uris->atom_Float ||
+        (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float) != (uint32_t)n) return 0;
+    memcpy(dst, vec + 1, n * sizeof(float));
+    return 1;
+}
+
+// the stage timings of run(), send about once a second
+static inline void read_dsp_profile(const X11LV2URIs* uris, X11_UI *ui,
+                                    const LV2_Atom_Object* obj) {
+    X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+    PerfOverlay *p = &ps->perf;
+    const LV2_Atom* mean = NULL;
+    const LV2_Atom* max = NULL;
+    const LV2_Atom* misses = NULL;
+    const LV2_Atom* budget = NULL;
+    const LV2_Atom* parallel = NULL;
+    lv2_atom_object_get(obj, uris->dsp_mean, &mean, uris->dsp_max, &max,
+                            uris->dsp_misses, &misses, uris->dsp_budget, &budget,
+                            uris->dsp_parallel, &parallel, 0);
+    if (!read_float_vector(uris, mean, p->meanUs, STAGE_COUNT) ||
+        !read_float_vector(uris, max, p->maxUs, STAGE_COUNT)) {
+        return;
+    }
+    p->window = (p->window + 1) % PERF_RECENT;
+    p->misses[p->window] = (misses && misses->type == uris->atom_Int) ?
+                                ((LV2_Atom_Int*)misses)->body : 0;
+    if (budget && budget->type == uris->atom_Float)
+        p->budgetUs = ((LV2_Atom_Float*)budget)->body;
+    if (parallel && parallel->type == uris->atom_Float)
+        p->efficiency = ((LV2_Atom_Float*)parallel)->body;
+    p->dirty = 1;
+}
+
+// the counters of the parallel processor, the worker is not of interest here
+static inline void read_thread_stats(const X11LV2URIs* uris, X11_UI *ui,
+                                    const LV2_Atom_Object* obj) {
+    X11_UI_Private_t *ps = (X11_UI_Private_t*)ui->private_ptr;
+    PerfOverlay *p = &ps->perf;
+    const LV2_Atom* thread = NULL;
+    const LV2_Atom* fallbacks = NULL;
+    const LV2_Atom* timeouts = NULL;
+    const LV2_Atom* dropped = NULL;
+    lv2_atom_object_get(obj, uris->thread, &thread, uris->fallbacks, &fallbacks,
+                            uris->timeouts, &timeouts, uris->dropped, &dropped, 0);
+    if (!thread || thread->type != uris->atom_String ||
+        strcmp((const char*)LV2_ATOM_BODY_CONST(thread), "pro") != 0) {
+        return;
+    }
+    if (fallbacks && fallbacks->type == uris->atom_Int)
+        p->fallbacks = ((LV2_Atom_Int*)fallbacks)->body;
+    if (timeouts && timeouts->type == uris->atom_Int)
+        p->timeouts = ((LV2_Atom_Int*)timeouts)->body;
+    if (dropped && dropped->type == uris->atom_Int)
+        p->dropped = ((LV2_Atom_Int*)dropped)->body;
+    p->dirty = 1;
+}
+
 void plugin_port_event(LV2UI_Handle handle, uint32_t port_index,
                         uint32_t buffer_size, uint32_t format,
                         const void * buffer) {
@@ -506,6 +756,12 @@ void plugin_port_event(LV2UI_Handle handle, uint32_t port_index,
                 if (file_uri && m) {
                     get_file(file_uri, ui, m);
                 }
+            } else if (obj->body.otype == uris->load_event) {
+                read_load_event(uris, ui, obj);
+            } else if (obj->body.otype == uris->dsp_profile) {
+                read_dsp_profile(uris, ui, obj);
+            } else if (obj->body.otype == uris->thread_stats) {
+                read_thread_stats(uris, ui, obj);
             }
         }
     }
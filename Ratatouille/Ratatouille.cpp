@@ -19,6 +19,8 @@
 #include <cstring>
 #include <thread>
 #include <unistd.h>
+#include <climits>
+#include <vector>
 
 #include <lv2/core/lv2.h>
 #include <lv2/atom/atom.h>
@@ -48,8 +50,11 @@
 #include "dcblocker.cc"
 #include "cdelay.cc"
 
+#include "RatatouilleProfile.h"
+#include "RatatouilleMetrics.h"
 #include "ModelerSelector.h"
 #include "ParallelThread.h"
+#include "ForkJoin.h"
 
 #include "fftconvolver.cc"
 #include "fftconvolver.h"
@@ -98,6 +103,20 @@ public:
     inline ~DenormalProtection() {};
 };
 
+// the tasks of the processing chain, each group run in parallel:
+// slot A | slot B -> blend -> conv | conv1 -> mix
+// in pipeline mode the convolvers process the previous block:
+// models | convolvers -> blend -> mix
+enum ChainTask {
+    TASK_SLOT_A,
+    TASK_SLOT_B,
+    TASK_CONV,
+    TASK_CONV1,
+    TASK_MODELS,
+    TASK_CONVS,
+    TASK_GROUP_WIDTH = 2
+};
+
 ////////////////////////////// PLUG-IN CLASS ///////////////////////////
 
 class Xratatouille
@@ -110,8 +129,12 @@ private:
     SingleThreadConvolver        conv;
     SingleThreadConvolver        conv1;
     ParallelThread               xrworker;
-    ParallelThread               pro;
+    ForkJoin                     pro;
     DenormalProtection           MXCSR;
+    Profile                      profile;
+    TraceRing*                   traceRun;
+    TraceRing*                   tracePro;
+    TraceRing*                   traceWorker;
 
     int32_t                      rt_prio;
     int32_t                      rt_policy;
@@ -123,13 +146,26 @@ private:
     float*                       _blend;
     float*                       _mix;
     float*                       _delay;
+    float*                       _bufa;
     float*                       _bufb;
+    float*                       _cbufa;
+    float*                       _cbufb;
     float*                       _normA;
     float*                       _normB;
     uint32_t                     normA;
     uint32_t                     normB;
     float*                       _normSlotA;
     float*                       _normSlotB;
+    float*                       _dspLoad;
+    float                        dspLoad;
+    float*                       _pipeline;
+    float*                       _latency;
+    std::vector<float>           pipeA;
+    std::vector<float>           pipeB;
+    uint32_t                     pipeFrames;
+    uint32_t                     maxBlock;
+    bool                         runConv;
+    bool                         runConv1;
     double                       fRec0[2];
     double                       fRec3[2];
     double                       fRec2[2];
@@ -169,6 +205,27 @@ private:
     LV2_URID                     xlv2_ir_file;
     LV2_URID                     xlv2_ir_file1;
     LV2_URID                     xlv2_gui;
+    LV2_URID                     xlv2_dsp_profile;
+    LV2_URID                     xlv2_dsp_blocks;
+    LV2_URID                     xlv2_dsp_min;
+    LV2_URID                     xlv2_dsp_mean;
+    LV2_URID                     xlv2_dsp_max;
+    LV2_URID                     xlv2_dsp_misses;
+    LV2_URID                     xlv2_dsp_budget;
+    LV2_URID                     xlv2_dsp_parallel;
+    LV2_URID                     xlv2_thread_stats;
+    LV2_URID                     xlv2_thread;
+    LV2_URID                     xlv2_fallbacks;
+    LV2_URID                     xlv2_timeouts;
+    LV2_URID                     xlv2_dropped;
+    LV2_URID                     xlv2_max_wait;
+    LV2_URID                     xlv2_memory;
+    LV2_URID                     xlv2_memory_bytes;
+    LV2_URID                     xlv2_memory_total;
+    LV2_URID                     xlv2_load_event;
+    LV2_URID                     xlv2_load_slot;
+    LV2_URID                     xlv2_load_stage;
+    LV2_URID                     xlv2_load_time;
     LV2_URID                     atom_Object;
     LV2_URID                     atom_Int;
     LV2_URID                     atom_Float;
@@ -192,17 +249,29 @@ private:
     inline void clean_up();
     inline void do_work_mono();
     inline void deactivate_f();
+    inline void processSlotA();
     inline void processSlotB();
+    inline void processConv();
     inline void processConv1();
+    inline void processModels();
+    inline void processConvs();
     inline void map_uris(LV2_URID_Map* map);
     inline LV2_Atom* write_set_file(LV2_Atom_Forge* forge,
             const LV2_URID xlv2_model, const char* filename);
     inline const LV2_Atom* read_set_file(const LV2_Atom_Object* obj);
+    inline void write_dsp_profile(LV2_Atom_Forge* forge);
+    inline void write_thread_stats(LV2_Atom_Forge* forge, const char* name,
+            const ParallelThreadStats& stats);
+    inline void write_memory(LV2_Atom_Forge* forge);
+    inline void update_memory();
+    inline void write_load_event(LV2_Atom_Forge* forge, const LoadEvent& e);
+    inline void load_done(bool ok, const std::string& file);
 
 public:
     // LV2 Descriptor
     static const LV2_Descriptor descriptor;
     static const void* extension_data(const char* uri);
+    static const Profile* get_profile(LV2_Handle instance);
     // static wrapper to private functions
     static void deactivate(LV2_Handle instance);
     static void cleanup(LV2_Handle instance);
@@ -254,17 +323,47 @@ Xratatouille::Xratatouille() :
     _blend(0),
     _mix(0),
     _delay(0),
+    _bufa(0),
     _bufb(0),
+    _cbufa(0),
+    _cbufb(0),
     _normA(0),
-    _normB(0) {
+    _normB(0),
+    _dspLoad(0),
+    dspLoad(0.0f),
+    _pipeline(0),
+    _latency(0),
+    pipeFrames(0),
+    maxBlock(0),
+    runConv(false),
+    runConv1(false) {
+        traceRun = Tracer::get().add("run");
+        tracePro = Tracer::get().add("pro");
+        traceWorker = Tracer::get().add("xrworker");
+        profile.dsp.trace = traceRun;
+        profile.load.trace = traceWorker;
         xrworker.start();
         xrworker.set<Xratatouille, &Xratatouille::do_work_mono>(this);
         //xrworker.process = [=] () {do_work_mono();};
+        // each group of the chain has at most two independent tasks and
+        // the calling thread always run one of them by itself
+        pro.setHelpers(std::min<uint32_t>(TASK_GROUP_WIDTH - 1,
+            std::max<uint32_t>(1, std::thread::hardware_concurrency()) - 1));
+        // opt-in: share the helpers with all instances of the process
+        pro.useSharedPool(ForkJoinPool::get().enabled());
+        pro.setThreadName("RT");
+        // the tasks are traced by the thread which run them
+        pro.setTrace(traceRun, &tracePro, 1);
         pro.start();
+        profile.pro = &pro.getStats(0);
+        profile.worker = &xrworker.getStats();
+        profile.memory.set(MEMORY_DELAY, sizeof(cdeleay::Dsp));
+        MetricsRegistry::get().add(&profile);
         };
 
 // destructor
 Xratatouille::~Xratatouille() {
+    MetricsRegistry::get().remove(&profile);
     dcb->del_instance(dcb);
     cdelay->del_instance(cdelay);
     conv.stop_process();
@@ -273,6 +372,9 @@ Xratatouille::~Xratatouille() {
     conv1.cleanup();
     xrworker.stop();
     pro.stop();
+    Tracer::get().remove(traceRun);
+    Tracer::get().remove(tracePro);
+    Tracer::get().remove(traceWorker);
 };
 
 ///////////////////////// PRIVATE CLASS  FUNCTIONS /////////////////////
@@ -283,6 +385,27 @@ inline void Xratatouille::map_uris(LV2_URID_Map* map) {
     xlv2_ir_file =          map->map(map->handle, XLV2__IRFILE);
     xlv2_ir_file1 =         map->map(map->handle, XLV2__IRFILE1);
     xlv2_gui =              map->map(map->handle, XLV2__GUI);
+    xlv2_dsp_profile =      map->map(map->handle, XLV2__DSP_PROFILE);
+    xlv2_dsp_blocks =       map->map(map->handle, XLV2__DSP_BLOCKS);
+    xlv2_dsp_min =          map->map(map->handle, XLV2__DSP_MIN);
+    xlv2_dsp_mean =         map->map(map->handle, XLV2__DSP_MEAN);
+    xlv2_dsp_max =          map->map(map->handle, XLV2__DSP_MAX);
+    xlv2_dsp_misses =       map->map(map->handle, XLV2__DSP_MISSES);
+    xlv2_dsp_budget =       map->map(map->handle, XLV2__DSP_BUDGET);
+    xlv2_dsp_parallel =     map->map(map->handle, XLV2__DSP_PARALLEL);
+    xlv2_thread_stats =     map->map(map->handle, XLV2__THREAD_STATS);
+    xlv2_thread =           map->map(map->handle, XLV2__THREAD);
+    xlv2_fallbacks =        map->map(map->handle, XLV2__FALLBACKS);
+    xlv2_timeouts =         map->map(map->handle, XLV2__TIMEOUTS);
+    xlv2_dropped =          map->map(map->handle, XLV2__DROPPED);
+    xlv2_max_wait =         map->map(map->handle, XLV2__MAX_WAIT);
+    xlv2_memory =           map->map(map->handle, XLV2__MEMORY);
+    xlv2_memory_bytes =     map->map(map->handle, XLV2__MEMORY_BYTES);
+    xlv2_memory_total =     map->map(map->handle, XLV2__MEMORY_TOTAL);
+    xlv2_load_event =       map->map(map->handle, XLV2__LOAD_EVENT);
+    xlv2_load_slot =        map->map(map->handle, XLV2__LOAD_SLOT);
+    xlv2_load_stage =       map->map(map->handle, XLV2__LOAD_STAGE);
+    xlv2_load_time =        map->map(map->handle, XLV2__LOAD_TIME);
     atom_Object =           map->map(map->handle, LV2_ATOM__Object);
     atom_Int =              map->map(map->handle, LV2_ATOM__Int);
     atom_Float =            map->map(map->handle, LV2_ATOM__Float);
@@ -306,18 +429,36 @@ void Xratatouille::init_dsp_(uint32_t rate)
     cdelay->init(rate);
     slotA.init(rate);
     slotB.init(rate);
+    slotA.setProfile(&profile.load);
+    slotB.setProfile(&profile.load);
+    conv.set_profile(&profile.load);
+    conv1.set_profile(&profile.load);
 
     if (!rt_policy) rt_policy = 1; //SCHED_FIFO;
-    pro.setThreadName("RT");
     pro.setPriority(rt_prio, rt_policy);
-    pro.set<0, Xratatouille, &Xratatouille::processSlotB>(this);
-    pro.set<1, Xratatouille, &Xratatouille::processConv1>(this);
+    pro.set<TASK_SLOT_A, Xratatouille, &Xratatouille::processSlotA>(this, "slot A");
+    pro.set<TASK_SLOT_B, Xratatouille, &Xratatouille::processSlotB>(this, "slot B");
+    pro.set<TASK_CONV, Xratatouille, &Xratatouille::processConv>(this, "conv");
+    pro.set<TASK_CONV1, Xratatouille, &Xratatouille::processConv1>(this, "conv1");
+    pro.set<TASK_MODELS, Xratatouille, &Xratatouille::processModels>(this, "models");
+    pro.set<TASK_CONVS, Xratatouille, &Xratatouille::processConvs>(this, "convolvers");
+
+    // the block queued for the convolvers in pipeline mode
+    pipeA.assign(maxBlock, 0.0f);
+    pipeB.assign(maxBlock, 0.0f);
+    pipeFrames = 0;
 
     model_file = "None";
     model_file1 = "None";
 
     ir_file = "None";
     ir_file1 = "None";
+    // the file paths are assigned in run(), reserve the memory here
+    // so that a new path don't allocate in the real-time thread
+    model_file.reserve(PATH_MAX);
+    model_file1.reserve(PATH_MAX);
+    ir_file.reserve(PATH_MAX);
+    ir_file1.reserve(PATH_MAX);
     bufsize = 0;
 
     _execute.store(false, std::memory_order_release);
@@ -381,6 +522,15 @@ void Xratatouille::connect_(uint32_t port,void* data)
         case 13:
             _normSlotB = static_cast<float*>(data);
             break;
+        case 14:
+            _dspLoad = static_cast<float*>(data);
+            break;
+        case 15:
+            _pipeline = static_cast<float*>(data);
+            break;
+        case 16:
+            _latency = static_cast<float*>(data);
+            break;
         default:
             break;
     }
@@ -408,45 +558,61 @@ void Xratatouille::deactivate_f()
 
 void Xratatouille::do_work_mono()
 {
+    TraceScope t(traceWorker, "load");
+    profile.load.start(_ab.load(std::memory_order_acquire));
     // load Model in slot A
     if (_ab.load(std::memory_order_acquire) == 1) {
+        profile.load.begin(SLOT_MODEL_A);
         slotA.setModelFile(model_file);
         if (!slotA.loadModel()) {
+            load_done(false, model_file);
             model_file = "None";
             _neuralA.store(false, std::memory_order_release);
         } else {
+            load_done(true, model_file);
             _neuralA.store(true, std::memory_order_release);
         }
     // load Model in slot B
     } else if (_ab.load(std::memory_order_acquire) == 2) {
+        profile.load.begin(SLOT_MODEL_B);
         slotB.setModelFile(model_file1);
         if (!slotB.loadModel()) {
+            load_done(false, model_file1);
             model_file1 = "None";
             _neuralB.store(false, std::memory_order_release);
         } else {
+            load_done(true, model_file1);
             _neuralB.store(true, std::memory_order_release);
         }
     // load Models in slots A and B
     } else if (_ab.load(std::memory_order_acquire) == 3) {
+        profile.load.begin(SLOT_MODEL_A);
         slotA.setModelFile(model_file);
         if (!slotA.loadModel()) {
+            load_done(false, model_file);
             model_file = "None";
             _neuralA.store(false, std::memory_order_release);
         } else {
+            load_done(true, model_file);
             _neuralA.store(true, std::memory_order_release);
         }
+        profile.load.begin(SLOT_MODEL_B);
         slotB.setModelFile(model_file1);
         if (!slotB.loadModel()) {
+            load_done(false, model_file1);
             model_file1 = "None";
             _neuralB.store(false, std::memory_order_release);
         } else {
+            load_done(true, model_file1);
             _neuralB.store(true, std::memory_order_release);
         }
     // load IR file in first convolver
     } else if (_ab.load(std::memory_order_acquire) == 7) {
+        profile.load.begin(SLOT_IR_A);
         if (conv.is_runnable()) {
             conv.set_not_runnable();
             conv.stop_process();
+            PhaseTimer t(&profile.load, PHASE_SYNC);
             std::unique_lock<std::mutex> lk(WMutex);
             Sync.wait(lk);
         }
@@ -458,14 +624,19 @@ void Xratatouille::do_work_mono()
         conv.configure(ir_file, 1.0, 0, 0, 0, 0, 0);
         while (!conv.checkstate());
         if(!conv.start(rt_prio, rt_policy)) {
+            load_done(false, ir_file);
             ir_file = "None";
             printf("impulse convolver update fail\n");
+        } else {
+            load_done(true, ir_file);
         }
     // load IR file in second convolver
     } else if (_ab.load(std::memory_order_acquire) == 8) {
+        profile.load.begin(SLOT_IR_B);
         if (conv1.is_runnable()) {
             conv1.set_not_runnable();
             conv1.stop_process();
+            PhaseTimer t(&profile.load, PHASE_SYNC);
             std::unique_lock<std::mutex> lk(WMutex);
             Sync.wait(lk);
         }
@@ -477,34 +648,45 @@ void Xratatouille::do_work_mono()
         conv1.configure(ir_file1, 1.0, 0, 0, 0, 0, 0);
         while (!conv1.checkstate());
         if(!conv1.start(rt_prio, rt_policy)) {
+            load_done(false, ir_file1);
             ir_file1 = "None";
             printf("impulse convolver1 update fail\n");
+        } else {
+            load_done(true, ir_file1);
         }
     // load all models and IR files
     } else if (_ab.load(std::memory_order_acquire) > 10) {
         if (model_file != "None") {
+            profile.load.begin(SLOT_MODEL_A);
             slotA.setModelFile(model_file);
             if (!slotA.loadModel()) {
+                load_done(false, model_file);
                 model_file = "None";
                 _neuralA.store(false, std::memory_order_release);
             } else {
+                load_done(true, model_file);
                 _neuralA.store(true, std::memory_order_release);
             }
         } 
         if (model_file1 != "None") {
+            profile.load.begin(SLOT_MODEL_B);
             slotB.setModelFile(model_file1);
             if (!slotB.loadModel()) {
+                load_done(false, model_file1);
                 model_file1 = "None";
                 _neuralB.store(false, std::memory_order_release);
             } else {
+                load_done(true, model_file1);
                 _neuralB.store(true, std::memory_order_release);
             }
         } 
 
         if (ir_file != "None") {
+            profile.load.begin(SLOT_IR_A);
             if (conv.is_runnable()) {
                 conv.set_not_runnable();
                 conv.stop_process();
+                PhaseTimer t(&profile.load, PHASE_SYNC);
                 std::unique_lock<std::mutex> lk(WMutex);
                 Sync.wait(lk);
             }
@@ -516,8 +698,11 @@ void Xratatouille::do_work_mono()
             conv.configure(ir_file, 1.0, 0, 0, 0, 0, 0);
             while (!conv.checkstate());
             if(!conv.start(rt_prio, rt_policy)) {
+                load_done(false, ir_file);
                 ir_file = "None";
                 printf("impulse convolver update fail\n");
+            } else {
+                load_done(true, ir_file);
             }
         } else {
             if (conv.is_runnable()) {
@@ -526,9 +711,11 @@ void Xratatouille::do_work_mono()
             }            
         }
         if (ir_file1 != "None") {
+            profile.load.begin(SLOT_IR_B);
             if (conv1.is_runnable()) {
                 conv1.set_not_runnable();
                 conv1.stop_process();
+                PhaseTimer t(&profile.load, PHASE_SYNC);
                 std::unique_lock<std::mutex> lk(WMutex);
                 Sync.wait(lk);
             }
@@ -540,8 +727,11 @@ void Xratatouille::do_work_mono()
             conv1.configure(ir_file1, 1.0, 0, 0, 0, 0, 0);
             while (!conv1.checkstate());
             if(!conv1.start(rt_prio, rt_policy)) {
+                load_done(false, ir_file1);
                 ir_file1 = "None";
                 printf("impulse convolver1 update fail\n");
+            } else {
+                load_done(true, ir_file1);
             }
         } else {
             if (conv1.is_runnable()) {
@@ -552,6 +742,8 @@ void Xratatouille::do_work_mono()
     }
     // set wait function time out for parallel processor thread
     pro.setTimeOut(std::max(100,static_cast<int>((bufsize/(s_rate*0.000001))*0.1)));
+    profile.load.done();
+    update_memory();
     // set flag that work is done ready
     _execute.store(false, std::memory_order_release);
     // set flag that GUI need information about changed state
@@ -576,6 +768,102 @@ inline LV2_Atom* Xratatouille::write_set_file(LV2_Atom_Forge* forge,
     return set;
 }
 
+// prepare atom message with the stage timings of the last window
+inline void Xratatouille::write_dsp_profile(LV2_Atom_Forge* forge) {
+    const DspProfile& dsp = profile.dsp;
+    LV2_Atom_Forge_Frame frame;
+    lv2_atom_forge_frame_time(forge, 0);
+    lv2_atom_forge_object(forge, &frame, 1, xlv2_dsp_profile);
+
+    lv2_atom_forge_key(forge, xlv2_dsp_blocks);
+    lv2_atom_forge_int(forge, dsp.blocks);
+    lv2_atom_forge_key(forge, xlv2_dsp_min);
+    lv2_atom_forge_vector(forge, sizeof(float), atom_Float, STAGE_COUNT, dsp.minUs);
+    lv2_atom_forge_key(forge, xlv2_dsp_mean);
+    lv2_atom_forge_vector(forge, sizeof(float), atom_Float, STAGE_COUNT, dsp.meanUs);
+    lv2_atom_forge_key(forge, xlv2_dsp_max);
+    lv2_atom_forge_vector(forge, sizeof(float), atom_Float, STAGE_COUNT, dsp.maxUs);
+    lv2_atom_forge_key(forge, xlv2_dsp_misses);
+    lv2_atom_forge_int(forge, dsp.misses);
+    lv2_atom_forge_key(forge, xlv2_dsp_budget);
+    lv2_atom_forge_float(forge, dsp.budgetUs);
+    lv2_atom_forge_key(forge, xlv2_dsp_parallel);
+    lv2_atom_forge_float(forge, dsp.efficiency);
+
+    lv2_atom_forge_pop(forge, &frame);
+}
+
+// prepare atom message with the worst case counters of a ParallelThread
+inline void Xratatouille::write_thread_stats(LV2_Atom_Forge* forge, const char* name,
+                    const ParallelThreadStats& stats) {
+    LV2_Atom_Forge_Frame frame;
+    lv2_atom_forge_frame_time(forge, 0);
+    lv2_atom_forge_object(forge, &frame, 1, xlv2_thread_stats);
+
+    lv2_atom_forge_key(forge, xlv2_thread);
+    lv2_atom_forge_string(forge, name, strlen(name));
+    lv2_atom_forge_key(forge, xlv2_fallbacks);
+    lv2_atom_forge_int(forge, stats.fallbacks.load(std::memory_order_relaxed));
+    lv2_atom_forge_key(forge, xlv2_timeouts);
+    lv2_atom_forge_int(forge, stats.timeouts.load(std::memory_order_relaxed));
+    lv2_atom_forge_key(forge, xlv2_dropped);
+    lv2_atom_forge_int(forge, stats.dropped.load(std::memory_order_relaxed));
+    lv2_atom_forge_key(forge, xlv2_max_wait);
+    lv2_atom_forge_float(forge, stats.maxWaitNs.load(std::memory_order_relaxed) * 0.001f);
+
+    lv2_atom_forge_pop(forge, &frame);
+}
+
+// prepare atom message with the bytes held by each part
+inline void Xratatouille::write_memory(LV2_Atom_Forge* forge) {
+    int64_t bytes[MEMORY_COUNT];
+    for (int i = 0; i < MEMORY_COUNT; i++) bytes[i] = profile.memory.get(i);
+    LV2_Atom_Forge_Frame frame;
+    lv2_atom_forge_frame_time(forge, 0);
+    lv2_atom_forge_object(forge, &frame, 1, xlv2_memory);
+
+    lv2_atom_forge_key(forge, xlv2_memory_bytes);
+    lv2_atom_forge_vector(forge, sizeof(int64_t), forge->Long, MEMORY_COUNT, bytes);
+    lv2_atom_forge_key(forge, xlv2_memory_total);
+    lv2_atom_forge_long(forge, profile.memory.total());
+
+    lv2_atom_forge_pop(forge, &frame);
+}
+
+// non rt, count the memory held by the models and convolvers after a load
+inline void Xratatouille::update_memory() {
+    profile.memory.set(MEMORY_SLOT_A, slotA.memoryUsage());
+    profile.memory.set(MEMORY_SLOT_B, slotB.memoryUsage());
+    profile.memory.set(MEMORY_CONV, conv.memory_usage());
+    profile.memory.set(MEMORY_CONV1, conv1.memory_usage());
+    profile.memory.set(MEMORY_SHARED, gx_resample::FixedRateResampler::sharedMemory());
+    fprintf(stderr, "Ratatouille: memory");
+    for (int i = 0; i < MEMORY_COUNT; i++)
+        fprintf(stderr, " %s %.2f MiB,", MemoryPartNames[i], profile.memory.get(i) / 1048576.0);
+    fprintf(stderr, " total %.2f MiB\n", profile.memory.total() / 1048576.0);
+}
+
+// prepare atom message with a load stage of a slot and the time it took
+inline void Xratatouille::write_load_event(LV2_Atom_Forge* forge, const LoadEvent& e) {
+    LV2_Atom_Forge_Frame frame;
+    lv2_atom_forge_frame_time(forge, 0);
+    lv2_atom_forge_object(forge, &frame, 1, xlv2_load_event);
+
+    lv2_atom_forge_key(forge, xlv2_load_slot);
+    lv2_atom_forge_int(forge, e.slot);
+    lv2_atom_forge_key(forge, xlv2_load_stage);
+    lv2_atom_forge_int(forge, e.stage);
+    lv2_atom_forge_key(forge, xlv2_load_time);
+    lv2_atom_forge_float(forge, e.ms);
+
+    lv2_atom_forge_pop(forge, &frame);
+}
+
+// non rt, a slot set to "None" is unloaded, that is not a failure
+inline void Xratatouille::load_done(bool ok, const std::string& file) {
+    profile.load.finish(ok || file == "None");
+}
+
 // read atom message with file path
 inline const LV2_Atom* Xratatouille::read_set_file(const LV2_Atom_Object* obj) {
     if (obj->body.otype != patch_Set) {
@@ -606,20 +894,58 @@ inline const LV2_Atom* Xratatouille::read_set_file(const LV2_Atom_Object* obj) {
     return file_path;
 }
 
-// process slotB in parallel thread
+// the tasks of the fork/join chain, run on a helper thread or inline
+
+// process slot A
+inline void Xratatouille::processSlotA() {
+    const int64_t t0 = profileNow();
+    slotA.compute(bufsize, _bufa, _bufa);
+    if (*(_normSlotA)) slotA.normalize(bufsize, _bufa);
+    if (pro.isOffloaded(TASK_SLOT_A)) profile.dsp.addParallel(profileNow() - t0);
+}
+
+// process slot B
 inline void Xratatouille::processSlotB() {
+    const int64_t t0 = profileNow();
     slotB.compute(bufsize, _bufb, _bufb);
     if (*(_normSlotB)) slotB.normalize(bufsize, _bufb);
+    if (pro.isOffloaded(TASK_SLOT_B)) profile.dsp.addParallel(profileNow() - t0);
+}
+
+// process first convolver
+inline void Xratatouille::processConv() {
+    const int64_t t0 = profileNow();
+    conv.compute(bufsize, _cbufa, _cbufa);
+    if (pro.isOffloaded(TASK_CONV)) profile.dsp.addParallel(profileNow() - t0);
 }
 
-// process second convolver in parallel thread
+// process second convolver
 inline void Xratatouille::processConv1() {
-    conv1.compute(bufsize, _bufb, _bufb);
+    const int64_t t0 = profileNow();
+    conv1.compute(bufsize, _cbufb, _cbufb);
+    if (pro.isOffloaded(TASK_CONV1)) profile.dsp.addParallel(profileNow() - t0);
+}
+
+// pipeline mode: process both model slots
+inline void Xratatouille::processModels() {
+    const int64_t t0 = profileNow();
+    if (_neuralA.load(std::memory_order_acquire)) processSlotA();
+    if (_neuralB.load(std::memory_order_acquire)) processSlotB();
+    if (pro.isOffloaded(TASK_MODELS)) profile.dsp.addParallel(profileNow() - t0);
+}
+
+// pipeline mode: process both convolvers on the previous block
+inline void Xratatouille::processConvs() {
+    const int64_t t0 = profileNow();
+    if (runConv) processConv();
+    if (runConv1) processConv1();
+    if (pro.isOffloaded(TASK_CONVS)) profile.dsp.addParallel(profileNow() - t0);
 }
 
 void Xratatouille::run_dsp_(uint32_t n_samples)
 {
     if(n_samples<1) return;
+    const int64_t cycleStart = profileNow();
     MXCSR.set_();
     const uint32_t notify_capacity = this->notify->atom.size;
     lv2_atom_forge_set_buffer(&forge, (uint8_t*)notify, notify_capacity);
@@ -637,6 +963,7 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
                     write_set_file(&forge, xlv2_ir_file, ir_file.data());
                 if (ir_file1 != "None")
                     write_set_file(&forge, xlv2_ir_file1, ir_file1.data());
+                write_memory(&forge);
            } else if (obj->body.otype == patch_Set) {
                 const LV2_Atom* file_path = read_set_file(obj);
                 if (file_path) {
@@ -651,6 +978,7 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
                     if (!_execute.load(std::memory_order_acquire)) {
                         bufsize = n_samples;
                         _execute.store(true, std::memory_order_release);
+                        profile.load.request();
                         xrworker.runProcess();
                         //schedule->schedule_work(schedule->handle,  sizeof(bool), &doit);
                     }
@@ -662,6 +990,7 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
     if (!_execute.load(std::memory_order_acquire) && _restore.load(std::memory_order_acquire)) {
         _execute.store(true, std::memory_order_release);
         bufsize = n_samples;
+        profile.load.request();
         xrworker.runProcess();
         //schedule->schedule_work(schedule->handle,  sizeof(bool), &doit);
         _restore.store(false, std::memory_order_release);
@@ -674,6 +1003,7 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
         conv.set_normalisation(normA);
         if (ir_file.compare("None") != 0) {
             _execute.store(true, std::memory_order_release);
+            profile.load.request();
             xrworker.runProcess();
             //schedule->schedule_work(schedule->handle,  sizeof(bool), &doit);
             _restore.store(false, std::memory_order_release);
@@ -687,6 +1017,7 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
         conv1.set_normalisation(normB);
         if (ir_file1.compare("None") != 0) {
             _execute.store(true, std::memory_order_release);
+            profile.load.request();
             xrworker.runProcess();
             //schedule->schedule_work(schedule->handle,  sizeof(bool), &doit);
             _restore.store(false, std::memory_order_release);
@@ -712,8 +1043,10 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
     bufsize = n_samples;
 
     // process delta delay
+    profile.dsp.begin();
     if (*(_delay) < 0) cdelay->compute(n_samples, bufa, bufa);
     else cdelay->compute(n_samples, bufb, bufb);
+    profile.dsp.mark(STAGE_DELAY);
 
     // process input volume slot A
     if (_neuralA.load(std::memory_order_acquire)) {
@@ -732,26 +1065,48 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
             fRec4[1] = fRec4[0];
         }
     }
+    profile.dsp.mark(STAGE_INPUT);
+
+    // in pipeline mode the convolvers process the previous block,
+    // queued in pipeA/pipeB, while the models process this one.
+    // That add one block of latency.
+    const bool pipelined = _pipeline && *(_pipeline) > 0.5f && n_samples <= pipeA.size();
+    if (!pipelined) {
+        pipeFrames = 0;
+    } else if (pipeFrames != n_samples) {
+        // (re)start the pipeline with a silent block
+        memset(pipeA.data(), 0, n_samples*sizeof(float));
+        memset(pipeB.data(), 0, n_samples*sizeof(float));
+        pipeFrames = n_samples;
+    }
 
-    // process slot B in parallel thread
+    // fork the model slots, the scheduler keep the more expensive
+    // slot in this thread and hand the other to a helper thread.
+    // In pipeline mode fork the models and the convolvers instead.
+    _bufa = bufa;
     _bufb = bufb;
-    if (_neuralB.load(std::memory_order_acquire) && pro.getProcess()) {
-        pro.setProcessor(0);
-        pro.runProcess();
+    uint32_t tasks[TASK_GROUP_WIDTH];
+    uint32_t n = 0;
+    if (pipelined) {
+        _cbufa = pipeA.data();
+        _cbufb = pipeB.data();
+        runConv = !_execute.load(std::memory_order_acquire) && conv.is_runnable();
+        runConv1 = !_execute.load(std::memory_order_acquire) && conv1.is_runnable();
+        tasks[n++] = TASK_MODELS;
+        if (runConv || runConv1) tasks[n++] = TASK_CONVS;
     } else {
-        processSlotB();
+        if (_neuralA.load(std::memory_order_acquire)) tasks[n++] = TASK_SLOT_A;
+        if (_neuralB.load(std::memory_order_acquire)) tasks[n++] = TASK_SLOT_B;
     }
+    pro.fork(tasks, n);
 
-    // process slot A
-    if (_neuralA.load(std::memory_order_acquire)) {
-        slotA.compute(n_samples, bufa, bufa);
-        if (*(_normSlotA)) slotA.normalize(n_samples, bufa);
-    }
+    // process the slots kept for this thread
+    pro.runLocal();
+    profile.dsp.mark(STAGE_MODELS_LOCAL);
 
-    //wait for parallel processed slot B when needed
-    if (_neuralB.load(std::memory_order_acquire)) {
-        pro.processWait();
-    }
+    // join the slot or the convolvers processed by the helper
+    pro.wait();
+    profile.dsp.mark(STAGE_MODELS_WAIT);
 
     // mix output when needed
     if (_neuralA.load(std::memory_order_acquire) && _neuralB.load(std::memory_order_acquire)) {
@@ -774,45 +1129,73 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
             fRec3[1] = fRec3[0];
         }
     }
+    profile.dsp.mark(STAGE_BLEND);
 
     // run dcblocker
     dcb->compute(n_samples, output0, output0);
-
-    // set buffer for mix control
-    memcpy(bufa, output0, n_samples*sizeof(float));
-    memcpy(bufb, output0, n_samples*sizeof(float));
-
-    // process conv1 in parallel thread
-    _bufb = bufb;
-    if (!_execute.load(std::memory_order_acquire) && conv1.is_runnable()) {
-        if (pro.getProcess()) {
-            pro.setProcessor(1);
-            pro.runProcess();
-        } else {
-            processConv1();
-        }
+    profile.dsp.mark(STAGE_DCBLOCKER);
+
+    // the buffers processed by the convolvers
+    float* cbufa = bufa;
+    float* cbufb = bufb;
+    if (pipelined) {
+        // the convolvers are done with the previous block,
+        // keep it for the mix and queue this block for them
+        memcpy(bufa, pipeA.data(), n_samples*sizeof(float));
+        memcpy(bufb, pipeB.data(), n_samples*sizeof(float));
+        memcpy(pipeA.data(), output0, n_samples*sizeof(float));
+        memcpy(pipeB.data(), output0, n_samples*sizeof(float));
+        if (!runConv && !runConv1) memcpy(output0, bufa, n_samples*sizeof(float));
+    } else {
+        // set buffer for mix control
+        memcpy(bufa, output0, n_samples*sizeof(float));
+        memcpy(bufb, output0, n_samples*sizeof(float));
+
+        // fork the convolvers, placed by their measured cost
+        // like the model slots
+        _cbufa = cbufa;
+        _cbufb = cbufb;
+        runConv = !_execute.load(std::memory_order_acquire) && conv.is_runnable();
+        runConv1 = !_execute.load(std::memory_order_acquire) && conv1.is_runnable();
+        n = 0;
+        if (runConv) tasks[n++] = TASK_CONV;
+        if (runConv1) tasks[n++] = TASK_CONV1;
+        pro.fork(tasks, n);
+
+        // process the convolvers kept for this thread
+        pro.runLocal();
+        profile.dsp.mark(STAGE_CONVS_LOCAL);
+
+        // join the convolver processed by the helper
+        pro.wait();
+        profile.dsp.mark(STAGE_CONVS_WAIT);
     }
-    // process conv
-    if (!_execute.load(std::memory_order_acquire) && conv.is_runnable())
-        conv.compute(n_samples, bufa, bufa);
-
-    // wait for parallel processed conv1 when needed
-    if (!_execute.load(std::memory_order_acquire) && conv1.is_runnable())
-        pro.processWait();
 
     // mix output when needed
-    if ((!_execute.load(std::memory_order_acquire) && conv.is_runnable()) && conv1.is_runnable()) {
+    if (runConv && runConv1) {
         for (int i0 = 0; i0 < n_samples; i0 = i0 + 1) {
             fRec1[0] = fSlow1 + 0.999 * fRec1[1];
-            output0[i0] = bufa[i0] * (1.0 - fRec1[0]) + bufb[i0] * fRec1[0];
+            output0[i0] = cbufa[i0] * (1.0 - fRec1[0]) + cbufb[i0] * fRec1[0];
             fRec1[1] = fRec1[0];
         }
-    } else if (!_execute.load(std::memory_order_acquire) && conv.is_runnable()) {
-        memcpy(output0, bufa, n_samples*sizeof(float));
-    } else if (!_execute.load(std::memory_order_acquire) && conv1.is_runnable()) {
-        memcpy(output0, bufb, n_samples*sizeof(float));
+    } else if (runConv) {
+        memcpy(output0, cbufa, n_samples*sizeof(float));
+    } else if (runConv1) {
+        memcpy(output0, cbufb, n_samples*sizeof(float));
+    }
+    profile.dsp.mark(STAGE_MIX);
+
+    // publish the stage timings and thread counters about once a second
+    if (profile.dsp.end(std::max<uint32_t>(1, s_rate / n_samples))) {
+        write_dsp_profile(&forge);
+        write_thread_stats(&forge, "pro", pro.getStats(0));
+        write_thread_stats(&forge, "xrworker", xrworker.getStats());
     }
 
+    // forward the load stages queued by the worker thread
+    LoadEvent loadEvent;
+    while (profile.load.events.pop(&loadEvent)) write_load_event(&forge, loadEvent);
+
     // notify UI on changed model files
     if (_notify_ui.load(std::memory_order_acquire)) {
         _notify_ui.store(false, std::memory_order_release);
@@ -823,9 +1206,21 @@ void Xratatouille::run_dsp_(uint32_t n_samples)
         write_set_file(&forge, xlv2_ir_file, ir_file.data());
         write_set_file(&forge, xlv2_ir_file1, ir_file1.data());
         _ab.store(0, std::memory_order_release);
+        profile.load.notify();
     }
-    // notify neural modeller that process cycle is done
-    Sync.notify_all();
+    // notify neural modeller that process cycle is done,
+    // only the worker wait for it, while it runs
+    if (_execute.load(std::memory_order_acquire)) Sync.notify_all();
+
+    // report the used part of the block deadline in percent,
+    // smoothed with a time constant of 300ms
+    const int64_t cycleNs = profileNow() - cycleStart;
+    if (traceRun) traceRun->push("run", cycleStart, cycleNs);
+    profile.dsp.block(cycleNs, int64_t(n_samples) * 1000000000 / s_rate);
+    const float load = cycleNs * 1e-7f * s_rate / n_samples;
+    dspLoad += (load - dspLoad) * (1.0f - std::exp(-float(n_samples) / (0.3f * s_rate)));
+    if (_dspLoad) *(_dspLoad) = dspLoad;
+    if (_latency) *(_latency) = pipelined ? float(n_samples) : 0.0f;
     MXCSR.reset_();
 }
 
@@ -964,6 +1359,7 @@ Xratatouille::instantiate(const LV2_Descriptor* descriptor,
                 bufsize = *(const int32_t*)o->value;
             } else if (o->context == LV2_OPTIONS_INSTANCE &&
               o->key == bufsz_max && o->type == atom_Int) {
+                self->maxBlock = *(const int32_t*)o->value;
                 if (!bufsize)
                     bufsize = *(const int32_t*)o->value;
             } else if (o->context == LV2_OPTIONS_INSTANCE &&
@@ -975,6 +1371,7 @@ Xratatouille::instantiate(const LV2_Descriptor* descriptor,
             }
         }
 
+        if (!self->maxBlock) self->maxBlock = bufsize;
         if (bufsize == 0) {
             fprintf(stderr, "No maximum buffer size given.\n");
         } else {
@@ -1041,10 +1438,16 @@ LV2_Worker_Status Xratatouille::work_response(LV2_Handle instance,
   return LV2_WORKER_SUCCESS;
 }
 
+const Profile* Xratatouille::get_profile(LV2_Handle instance)
+{
+    return &static_cast<Xratatouille*>(instance)->profile;
+}
+
 const void* Xratatouille::extension_data(const char* uri)
 {
     static const LV2_Worker_Interface worker = { work, work_response, NULL };
     static const LV2_State_Interface  state  = { save_state, restore_state };
+    static const RatatouilleProfileInterface profile = { get_profile };
 
     if (!strcmp(uri, LV2_WORKER__interface)) {
         return &worker;
@@ -1052,6 +1455,9 @@ const void* Xratatouille::extension_data(const char* uri)
     else if (!strcmp(uri, LV2_STATE__interface)) {
         return &state;
     }
+    else if (!strcmp(uri, XLV2__PROFILE)) {
+        return &profile;
+    }
 
     return NULL;
 }
@@ -0,0 +1,435 @@
+/*
+ * RatatouilleMetrics.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** RatatouilleMetrics - process wide metrics of all Ratatouille instances
+ *
+ *  Set the environment variable RATATOUILLE_METRICS to a socket path
+ *  to enable it. Each instance register its Profile here, and a
+ *  server thread serve the metrics of all registered instances in the
+ *  Prometheus text format on a Unix domain socket at that path:
+ *
+ *      curl --unix-socket /tmp/ratatouille.sock http://localhost/metrics
+ *      socat - UNIX-CONNECT:/tmp/ratatouille.sock
+ *
+ *  A client which send a HTTP GET get a HTTP reply, any other client
+ *  get the plain text. The socket is created with the first instance
+ *  and removed with the last one. A socket still served by another
+ *  process is left alone and the exporter stay disabled.
+ *  The server only read the atomic counters of the Profile, it never
+ *  lock or wait for the audio thread.
+ *
+ *  MetricsRegistry - add() and remove() allocate and lock, call them
+ *                    outside of the real-time thread. add() returns
+ *                    false when the exporter is disabled.
+ *
+ *  usage:
+ *      MetricsRegistry::get().add(&profile);
+ *      ...
+ *      MetricsRegistry::get().remove(&profile);
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "RatatouilleProfile.h"
+
+#pragma once
+
+#ifndef RATATOUILLE_METRICS_H_
+#define RATATOUILLE_METRICS_H_
+
+namespace ratatouille {
+
+#if !defined(_WIN32)
+
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry& get() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    ~MetricsRegistry() {
+        std::unique_lock<std::mutex> lk(mutex);
+        instances.clear();
+        stopServer(lk);
+    }
+
+    // register the profile of an instance, false when the exporter is disabled
+    bool add(const Profile* profile) {
+        std::unique_lock<std::mutex> lk(mutex);
+        // startServer() clear the path when it fail, read it under the lock
+        if (path.empty()) return false;
+        if (!running && !startServer()) return false;
+        instances.push_back({ profile, ++lastId });
+        return true;
+    }
+
+    // the profile must stay valid until remove() returns
+    void remove(const Profile* profile) {
+        std::unique_lock<std::mutex> lk(mutex);
+        for (auto it = instances.begin(); it != instances.end(); ++it) {
+            if (it->profile == profile) {
+                instances.erase(it);
+                break;
+            }
+        }
+        if (instances.empty()) stopServer(lk);
+    }
+
+private:
+    struct Instance {
+        const Profile* profile;
+        uint32_t       id;
+    };
+
+    std::mutex            mutex;
+    std::vector<Instance> instances;
+    std::thread           server;
+    std::atomic<bool>     running;
+    std::string           path;
+    int                   fd;
+    uint32_t              lastId;
+
+    MetricsRegistry() : running(false), fd(-1), lastId(0) {
+        const char* p = getenv("RATATOUILLE_METRICS");
+        if (p) path = p;
+    }
+
+    bool startServer() {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "RatatouilleMetrics: socket path too long %s\n", path.c_str());
+            path.clear();
+            return false;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            fprintf(stderr, "RatatouilleMetrics: fail to create socket\n");
+            return false;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        // a socket left by a crashed process would block the bind,
+        // but don't take over one another process still serve
+        if (inUse(addr)) {
+            fprintf(stderr, "RatatouilleMetrics: %s is served by another process\n", path.c_str());
+            close(fd);
+            fd = -1;
+            path.clear();
+            return false;
+        }
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+            fprintf(stderr, "RatatouilleMetrics: fail to listen on %s\n", path.c_str());
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        running.store(true, std::memory_order_release);
+        server = std::thread([this]() { run(); });
+        return true;
+    }
+
+    // true when a server accept connections on the path,
+    // remove the socket when it is stale
+    static bool inUse(const struct sockaddr_un& addr) {
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe < 0) return false;
+        const bool connected = connect(probe, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+        const int err = errno;
+        close(probe);
+        if (connected) return true;
+        if (err == ECONNREFUSED) unlink(addr.sun_path);
+        return false;
+    }
+
+    void stopServer(std::unique_lock<std::mutex>& lk) {
+        if (!running.load(std::memory_order_acquire)) return;
+        running.store(false, std::memory_order_release);
+        lk.unlock();
+        server.join();
+        lk.lock();
+        close(fd);
+        fd = -1;
+        unlink(path.c_str());
+    }
+
+    void run() {
+        struct pollfd p = { fd, POLLIN, 0 };
+        while (running.load(std::memory_order_acquire)) {
+            if (poll(&p, 1, 200) <= 0 || !(p.revents & POLLIN)) continue;
+            const int client = accept(fd, nullptr, nullptr);
+            if (client < 0) continue;
+            serve(client);
+            close(client);
+        }
+    }
+
+    // read the request when one is send, a HTTP GET get a HTTP reply
+    void serve(int client) {
+        char request[1024];
+        ssize_t n = 0;
+        struct pollfd p = { client, POLLIN, 0 };
+        if (poll(&p, 1, 100) > 0 && (p.revents & POLLIN))
+            n = recv(client, request, sizeof(request), 0);
+        std::string body;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            format(body);
+        }
+        std::string reply;
+        if (n >= 4 && strncmp(request, "GET ", 4) == 0) {
+            reply = "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                    "Connection: close\r\n\r\n";
+        }
+        reply += body;
+        const char* data = reply.data();
+        size_t left = reply.size();
+        while (left) {
+            const ssize_t w = send(client, data, left, MSG_NOSIGNAL);
+            if (w <= 0) break;
+            data += w;
+            left -= w;
+        }
+    }
+
+    static void family(std::string& out, const char* name, const char* type, const char* help) {
+        out += "# HELP ";
+        out += name;
+        out += " ";
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += " ";
+        out += type;
+        out += "\n";
+    }
+
+    static void sample(std::string& out, const char* name, uint32_t id,
+                       const char* label, const char* value, double v) {
+        char line[256];
+        if (label) {
+            snprintf(line, sizeof(line), "%s{instance=\"%u\",%s=\"%s\"} %.9g\n", name, id, label, value, v);
+        } else {
+            snprintf(line, sizeof(line), "%s{instance=\"%u\"} %.9g\n", name, id, v);
+        }
+        out += line;
+    }
+
+    // all samples of a family must follow its header, so loop over
+    // the instances for each family
+    void format(std::string& out) {
+        static const float quantiles[] = { 0.5f, 0.9f, 0.99f, 0.999f };
+        static const char* const quantileNames[] = { "0.5", "0.9", "0.99", "0.999" };
+
+        out += "# HELP ratatouille_instances Ratatouille instances in the process.\n"
+               "# TYPE ratatouille_instances gauge\n";
+        out += "ratatouille_instances " + std::to_string(instances.size()) + "\n";
+
+        family(out, "ratatouille_block_seconds", "summary", "Time of a run() call.");
+        for (auto& i : instances) {
+            const BlockHistogram& h = i.profile->dsp.blockTime;
+            uint64_t c[BlockHistogram::buckets];
+            uint64_t n = 0;
+            for (int b = 0; b < BlockHistogram::buckets; b++) {
+                c[b] = h.counts[b].load(std::memory_order_relaxed);
+                n += c[b];
+            }
+            const float maxUs = h.maxNs.load(std::memory_order_relaxed) * 0.001f;
+            for (int q = 0; q < 4; q++)
+                sample(out, "ratatouille_block_seconds", i.id, "quantile", quantileNames[q],
+                    BlockHistogram::quantileUs(c, quantiles[q], maxUs) * 1e-6);
+            sample(out, "ratatouille_block_seconds_sum", i.id, nullptr, nullptr,
+                h.sumNs.load(std::memory_order_relaxed) * 1e-9);
+            sample(out, "ratatouille_block_seconds_count", i.id, nullptr, nullptr, n);
+        }
+        family(out, "ratatouille_block_max_seconds", "gauge", "Longest run() call.");
+        for (auto& i : instances)
+            sample(out, "ratatouille_block_max_seconds", i.id, nullptr, nullptr,
+                i.profile->dsp.blockTime.maxNs.load(std::memory_order_relaxed) * 1e-9);
+
+        formatStages(out);
+        formatThreads(out);
+        formatLoads(out);
+
+        family(out, "ratatouille_memory_bytes", "gauge", "Bytes held by each part, the shared part is the same for all instances.");
+        for (auto& i : instances)
+            for (int m = 0; m < MEMORY_COUNT; m++)
+                sample(out, "ratatouille_memory_bytes", i.id, "part", MemoryPartNames[m],
+                    i.profile->memory.get(m));
+    }
+
+    // the mean and max of each stage of run_dsp_() in the last window
+    void formatStages(std::string& out) {
+        struct Window {
+            float meanUs[STAGE_COUNT];
+            float maxUs[STAGE_COUNT];
+        };
+        std::vector<Window> snaps(instances.size());
+        std::vector<bool> valid;
+        for (size_t k = 0; k < instances.size(); k++) {
+            const DspProfile& d = instances[k].profile->dsp;
+            Window& s = snaps[k];
+            bool ok = false;
+            for (int retry = 0; !ok && retry < 4; retry++) {
+                const uint32_t serial = d.serial.load(std::memory_order_acquire);
+                if (serial & 1) continue;
+                memcpy(s.meanUs, d.meanUs, sizeof(s.meanUs));
+                memcpy(s.maxUs, d.maxUs, sizeof(s.maxUs));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                ok = d.serial.load(std::memory_order_relaxed) == serial;
+            }
+            valid.push_back(ok && d.blocks);
+        }
+        family(out, "ratatouille_stage_mean_seconds", "gauge", "Mean time of a stage of run() in the last window.");
+        for (size_t k = 0; k < instances.size(); k++) {
+            if (!valid[k]) continue;
+            for (int st = 0; st < STAGE_COUNT; st++)
+                sample(out, "ratatouille_stage_mean_seconds", instances[k].id, "stage",
+                    DspStageNames[st], snaps[k].meanUs[st] * 1e-6);
+        }
+        family(out, "ratatouille_stage_max_seconds", "gauge", "Max time of a stage of run() in the last window.");
+        for (size_t k = 0; k < instances.size(); k++) {
+            if (!valid[k]) continue;
+            for (int st = 0; st < STAGE_COUNT; st++)
+                sample(out, "ratatouille_stage_max_seconds", instances[k].id, "stage",
+                    DspStageNames[st], snaps[k].maxUs[st] * 1e-6);
+        }
+    }
+
+    // the misses of the parallel processor and of the worker thread
+    void formatThreads(std::string& out) {
+        struct Counter {
+            const char* name;
+            const char* help;
+            std::atomic<uint32_t> ParallelThreadStats::* value;
+        };
+        static const Counter counters[] = {
+            { "ratatouille_thread_fallbacks_total", "Jobs run in the calling thread because the thread was busy.",
+                &ParallelThreadStats::fallbacks },
+            { "ratatouille_thread_timeouts_total", "Waits for the thread which expired.",
+                &ParallelThreadStats::timeouts },
+            { "ratatouille_thread_dropped_total", "Waits which gave up, the processed data is lost.",
+                &ParallelThreadStats::dropped }
+        };
+        for (auto& c : counters) {
+            family(out, c.name, "counter", c.help);
+            for (auto& i : instances) {
+                if (i.profile->pro)
+                    sample(out, c.name, i.id, "thread", "pro",
+                        (i.profile->pro->*c.value).load(std::memory_order_relaxed));
+                if (i.profile->worker)
+                    sample(out, c.name, i.id, "thread", "xrworker",
+                        (i.profile->worker->*c.value).load(std::memory_order_relaxed));
+            }
+        }
+        family(out, "ratatouille_thread_max_wait_seconds", "gauge", "Longest wait for the thread.");
+        for (auto& i : instances) {
+            if (i.profile->pro)
+                sample(out, "ratatouille_thread_max_wait_seconds", i.id, "thread", "pro",
+                    i.profile->pro->maxWaitNs.load(std::memory_order_relaxed) * 1e-9);
+            if (i.profile->worker)
+                sample(out, "ratatouille_thread_max_wait_seconds", i.id, "thread", "xrworker",
+                    i.profile->worker->maxWaitNs.load(std::memory_order_relaxed) * 1e-9);
+        }
+    }
+
+    // the load counters, and the stages and phases of the last load
+    void formatLoads(std::string& out) {
+        family(out, "ratatouille_loads_total", "counter", "Finished load requests.");
+        for (auto& i : instances)
+            sample(out, "ratatouille_loads_total", i.id, nullptr, nullptr,
+                i.profile->load.loads.load(std::memory_order_relaxed));
+        family(out, "ratatouille_load_failures_total", "counter", "Files which fail to load.");
+        for (auto& i : instances)
+            sample(out, "ratatouille_load_failures_total", i.id, nullptr, nullptr,
+                i.profile->load.failures.load(std::memory_order_relaxed));
+        family(out, "ratatouille_load_seconds_total", "counter", "Time from request to UI notification of all loads.");
+        for (auto& i : instances)
+            sample(out, "ratatouille_load_seconds_total", i.id, nullptr, nullptr,
+                i.profile->load.loadNs.load(std::memory_order_relaxed) * 1e-9);
+
+        struct Last {
+            int64_t stage[3];
+            int64_t phase[PHASE_COUNT];
+            bool    valid;
+        };
+        std::vector<Last> last(instances.size());
+        for (size_t k = 0; k < instances.size(); k++) {
+            const LoadProfile& p = instances[k].profile->load;
+            const uint32_t serial = p.serial.load(std::memory_order_acquire);
+            const int64_t request = p.requestNs;
+            const int64_t start = p.startNs;
+            const int64_t done = p.doneNs;
+            const int64_t notify = p.notifyNs;
+            memcpy(last[k].phase, p.phaseNs, sizeof(last[k].phase));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            last[k].stage[0] = start - request;
+            last[k].stage[1] = done - start;
+            last[k].stage[2] = notify - done;
+            // skip when none finished yet or the next one is running
+            last[k].valid = serial && p.serial.load(std::memory_order_relaxed) == serial &&
+                request <= start && start <= done && done <= notify;
+        }
+        static const char* const stageNames[3] = { "queue", "work", "notify" };
+        family(out, "ratatouille_last_load_seconds", "gauge", "Stages of the last load.");
+        for (size_t k = 0; k < instances.size(); k++) {
+            if (!last[k].valid) continue;
+            for (int st = 0; st < 3; st++)
+                sample(out, "ratatouille_last_load_seconds", instances[k].id, "stage",
+                    stageNames[st], last[k].stage[st] * 1e-9);
+        }
+        family(out, "ratatouille_last_load_phase_seconds", "gauge", "Phases of the last load.");
+        for (size_t k = 0; k < instances.size(); k++) {
+            if (!last[k].valid) continue;
+            for (int ph = 0; ph < PHASE_COUNT; ph++)
+                sample(out, "ratatouille_last_load_phase_seconds", instances[k].id, "phase",
+                    LoadPhaseNames[ph], last[k].phase[ph] * 1e-9);
+        }
+    }
+};
+
+#else // _WIN32
+
+// no Unix domain sockets, the exporter is disabled
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry& get() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+    inline bool add(const Profile*) { return false; }
+    inline void remove(const Profile*) {}
+};
+
+#endif // _WIN32
+
+} // end namespace ratatouille
+
+#endif // RATATOUILLE_METRICS_H_
@@ -0,0 +1,538 @@
+/*
+ * RatatouilleProfile.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** RatatouilleProfile - runtime statistics of a Ratatouille instance
+ *
+ *  The plugin fill a Profile while it runs, a host (or a benchmark)
+ *  could read it by the private LV2 extension XLV2__PROFILE:
+ *
+ *      const RatatouilleProfileInterface* iface =
+ *          (const RatatouilleProfileInterface*)
+ *              descriptor->extension_data(XLV2__PROFILE);
+ *      const ratatouille::Profile* profile = iface->get_profile(handle);
+ *
+ *  LoadProfile - time stamps of the stages of the last finished load
+ *                request (patch:Set, state restore or normalisation),
+ *                and the time spend in each load phase.
+ *                The time stamps are steady_clock nanoseconds.
+ *                serial is incremented when the UI notification for
+ *                a load is written to the notify port, read serial
+ *                before and after copying the values to get a
+ *                consistent snapshot without locking.
+ *                events queue the progress of each load for the UI,
+ *                the worker push a LoadEvent when a phase ends and
+ *                when a slot is swapped in or fail, run() send them
+ *                as XLV2__LOAD_EVENT objects on the NOTIFY port.
+ *                loads, failures and loadNs count all loads since
+ *                instantiation for the metrics exporter.
+ *
+ *  DspProfile  - min/mean/max time spend in each stage of run_dsp_()
+ *                over a window of blocks (about one second). The
+ *                audio thread publish each full window here and as
+ *                a XLV2__DSP_PROFILE object on the NOTIFY port.
+ *                serial is odd while a window is published, read it
+ *                before and after copying the values, a even and
+ *                unchanged serial means a consistent snapshot.
+ *                blockTime count the time of each run() call in
+ *                fixed buckets, see BlockHistogram.
+ *                With each window the blocks which miss the deadline,
+ *                the deadline and the parallel efficiency are
+ *                published too. The efficiency is the part of the
+ *                work of the helper threads (whichever slot or
+ *                convolver the scheduler handed over) which the audio
+ *                thread don't wait for, -1 when nothing run in parallel.
+ *                The tasks are placed by their cost, so the local and
+ *                wait stages time whatever task run where.
+ *
+ *  pro, worker - the worst case counters of the parallel processor
+ *                and of the worker thread which load the files,
+ *                see ParallelThread.h, null before instantiation.
+ *                Both are send with each DspProfile window as a
+ *                XLV2__THREAD_STATS object on the NOTIFY port too.
+ *
+ *  MemoryProfile - bytes held by each model slot, convolver and the
+ *                delay line, updated by the worker after each load.
+ *                The plugin log them on load and reply with them as a
+ *                XLV2__MEMORY object to a patch:Get on the CONTROL port.
+ *                The model size is the size of its weights, the
+ *                convolver size is computed from the FFT partitioning.
+ *
+ *  PhaseTimer  - scoped timer which add the elapsed time to a phase
+ *                on destruction or stop(), does nothing when no
+ *                LoadProfile is set.
+ *
+ *  trace       - LoadProfile and DspProfile forward each phase and
+ *                stage to their TraceRing when one is set, see
+ *                RatatouilleTrace.h.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <lv2/core/lv2.h>
+
+#include "ParallelThread.h"
+#include "RatatouilleTrace.h"
+
+#pragma once
+
+#ifndef RATATOUILLE_PROFILE_H_
+#define RATATOUILLE_PROFILE_H_
+
+#define XLV2__PROFILE "urn:brummer:ratatouille#profile"
+#define XLV2__DSP_PROFILE "urn:brummer:ratatouille#dspProfile"
+#define XLV2__DSP_BLOCKS "urn:brummer:ratatouille#dspBlocks"
+#define XLV2__DSP_MIN "urn:brummer:ratatouille#dspMin"
+#define XLV2__DSP_MEAN "urn:brummer:ratatouille#dspMean"
+#define XLV2__DSP_MAX "urn:brummer:ratatouille#dspMax"
+#define XLV2__DSP_MISSES "urn:brummer:ratatouille#dspMisses"
+#define XLV2__DSP_BUDGET "urn:brummer:ratatouille#dspBudget"
+#define XLV2__DSP_PARALLEL "urn:brummer:ratatouille#dspParallel"
+#define XLV2__THREAD_STATS "urn:brummer:ratatouille#threadStats"
+#define XLV2__THREAD "urn:brummer:ratatouille#thread"
+#define XLV2__FALLBACKS "urn:brummer:ratatouille#fallbacks"
+#define XLV2__TIMEOUTS "urn:brummer:ratatouille#timeouts"
+#define XLV2__DROPPED "urn:brummer:ratatouille#dropped"
+#define XLV2__MAX_WAIT "urn:brummer:ratatouille#maxWait"
+#define XLV2__LOAD_EVENT "urn:brummer:ratatouille#loadEvent"
+#define XLV2__LOAD_SLOT "urn:brummer:ratatouille#loadSlot"
+#define XLV2__LOAD_STAGE "urn:brummer:ratatouille#loadStage"
+#define XLV2__LOAD_TIME "urn:brummer:ratatouille#loadTime"
+#define XLV2__MEMORY "urn:brummer:ratatouille#memory"
+#define XLV2__MEMORY_BYTES "urn:brummer:ratatouille#memoryBytes"
+#define XLV2__MEMORY_TOTAL "urn:brummer:ratatouille#memoryTotal"
+
+namespace ratatouille {
+
+enum LoadPhase {
+    PHASE_SYNC,         // wait for the audio thread to release a model/convolver
+    PHASE_READ,         // read the file
+    PHASE_PARSE,        // parse the model and build the network
+    PHASE_RESAMPLE,     // resampler setup, IR resampling
+    PHASE_WARMUP,       // model warm up run
+    PHASE_PARTITION,    // FFT partitioning of the IR
+    PHASE_COUNT
+};
+
+static const char* const LoadPhaseNames[PHASE_COUNT] = {
+    "sync", "read", "parse", "resample", "warmup", "partition"
+};
+
+enum LoadSlot {
+    SLOT_MODEL_A,
+    SLOT_MODEL_B,
+    SLOT_IR_A,
+    SLOT_IR_B,
+    SLOT_ALL,           // session restore
+    SLOT_COUNT
+};
+
+static const char* const LoadSlotNames[SLOT_COUNT] = {
+    "model A", "model B", "IR A", "IR B", "all"
+};
+
+// keep in sync with the UI in Ratatouille.c
+enum LoadStage {
+    LOAD_QUEUED,        // time from the request to the worker start
+    LOAD_READING,       // read the file
+    LOAD_PARSING,       // parse the model and build the network
+    LOAD_RESAMPLING,    // resampler setup, IR resampling
+    LOAD_WARMUP,        // model warm up run
+    LOAD_PARTITIONING,  // FFT partitioning of the IR
+    LOAD_SWAPPED,       // the slot run the new file, time of the whole slot load
+    LOAD_FAILED,        // the file could not be loaded, time of the whole slot load
+    LOAD_STAGE_COUNT
+};
+
+static const char* const LoadStageNames[LOAD_STAGE_COUNT] = {
+    "queued", "reading", "parsing", "resampling", "warming up", "partitioning", "swapped in", "failed"
+};
+
+enum DspStage {
+    STAGE_DELAY,        // delta delay
+    STAGE_INPUT,        // input gain of slot A and B
+    STAGE_MODELS_LOCAL, // fork the model slots, run the slots kept for the audio thread,
+                        // in pipeline mode the models and the convolvers
+    STAGE_MODELS_WAIT,  // wait for the slots run on a helper thread
+    STAGE_BLEND,        // blend of slot A and B, output gain
+    STAGE_DCBLOCKER,    // dcblocker
+    STAGE_CONVS_LOCAL,  // fork the convolvers, run the ones kept for the audio thread
+    STAGE_CONVS_WAIT,   // wait for the convolvers run on a helper thread
+    STAGE_MIX,          // mix of the convolvers
+    STAGE_COUNT
+};
+
+static const char* const DspStageNames[STAGE_COUNT] = {
+    "delay", "input", "models local", "models wait", "blend", "dcblocker",
+    "convs local", "convs wait", "mix"
+};
+
+enum MemoryPart {
+    MEMORY_SLOT_A,      // model and resampler of slot A
+    MEMORY_SLOT_B,      // model and resampler of slot B
+    MEMORY_CONV,        // first convolver
+    MEMORY_CONV1,       // second convolver
+    MEMORY_DELAY,       // delta delay line
+    MEMORY_SHARED,      // resampler filter tables of the process, not in total()
+    MEMORY_COUNT
+};
+
+static const char* const MemoryPartNames[MEMORY_COUNT] = {
+    "slot A", "slot B", "conv", "conv1", "delay", "shared"
+};
+
+inline int64_t profileNow() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct LoadEvent {
+    int32_t slot;
+    int32_t stage;
+    float   ms;
+};
+
+// single producer/single consumer queue of LoadEvents,
+// a full queue drop the event
+class LoadEvents
+{
+public:
+    static const uint32_t capacity = 64;   // power of two
+
+    LoadEvents() : head(0), tail(0) {}
+
+    // called from the worker thread
+    inline bool push(int32_t slot, int32_t stage, int64_t ns) noexcept {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= capacity) return false;
+        events[h & (capacity - 1)] = { slot, stage, ns * 1e-6f };
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // called from run()
+    inline bool pop(LoadEvent* e) noexcept {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        *e = events[t & (capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    LoadEvent             events[capacity];
+};
+
+// histogram of the run() time, single writer (the audio thread),
+// readers get the counts without locking
+class BlockHistogram
+{
+public:
+    static const int buckets = 20;
+    // upper bounds in microseconds, the last bucket is unbound
+    static constexpr float boundUs[buckets - 1] = {
+        5, 10, 20, 50, 100, 150, 200, 300, 500, 750,
+        1000, 1500, 2000, 3000, 5000, 7500, 10000, 20000, 50000
+    };
+
+    std::atomic<uint64_t> counts[buckets];
+    std::atomic<int64_t>  sumNs;
+    std::atomic<int64_t>  maxNs;
+
+    BlockHistogram() : sumNs(0), maxNs(0) {
+        for (int i = 0; i < buckets; i++) counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    // called from run()
+    inline void add(int64_t ns) noexcept {
+        const float us = ns * 0.001f;
+        int i = 0;
+        while (i < buckets - 1 && us > boundUs[i]) i++;
+        counts[i].store(counts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sumNs.store(sumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed))
+            maxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    // estimate the quantile q (0..1) in microseconds from a copy of the
+    // counts, linear within the bucket, the max for the unbound bucket
+    static float quantileUs(const uint64_t* c, float q, float maxUs) noexcept {
+        uint64_t n = 0;
+        for (int i = 0; i < buckets; i++) n += c[i];
+        if (!n) return 0.0f;
+        const double rank = q * n;
+        uint64_t below = 0;
+        for (int i = 0; i < buckets - 1; i++) {
+            if (below + c[i] >= rank && c[i]) {
+                const float lo = i ? boundUs[i - 1] : 0.0f;
+                return std::min(maxUs, float(lo + (boundUs[i] - lo) * (rank - below) / c[i]));
+            }
+            below += c[i];
+        }
+        return maxUs;
+    }
+};
+
+class LoadProfile
+{
+public:
+    std::atomic<uint32_t> serial;
+    int32_t               job;          // _ab value of the load request
+    int64_t               requestNs;    // patch:Set seen in run()
+    int64_t               startNs;      // worker start to load
+    int64_t               doneNs;       // worker finished
+    int64_t               notifyNs;     // UI notification written
+    int64_t               phaseNs[PHASE_COUNT];
+    TraceRing*            trace;        // worker thread ring or null
+    LoadEvents            events;       // progress for the UI
+    std::atomic<uint32_t> loads;        // finished load requests
+    std::atomic<uint32_t> failures;     // slots which fail to load
+    std::atomic<int64_t>  loadNs;       // request to notification, all loads
+
+    LoadProfile() : serial(0), trace(nullptr), loads(0), failures(0), loadNs(0),
+        slot(SLOT_ALL), slotNs(0) { clear(); }
+
+    void clear() noexcept {
+        job = 0;
+        requestNs = startNs = doneNs = notifyNs = 0;
+        memset(phaseNs, 0, sizeof(phaseNs));
+    }
+
+    // called from run() when the worker is triggered
+    inline void request() noexcept {
+        requestNs = profileNow();
+    }
+
+    // called from the worker thread
+    inline void start(int32_t job_) noexcept {
+        job = job_;
+        startNs = profileNow();
+        memset(phaseNs, 0, sizeof(phaseNs));
+        slot = jobSlot(job);
+        slotNs = startNs;
+        events.push(slot, LOAD_QUEUED, startNs - requestNs);
+    }
+
+    // a slot of the job start to load
+    inline void begin(int32_t slot_) noexcept {
+        slot = slot_;
+        slotNs = profileNow();
+    }
+
+    // the slot run the new file, or fail to load it
+    inline void finish(bool ok) noexcept {
+        if (!ok) failures.fetch_add(1, std::memory_order_relaxed);
+        events.push(slot, ok ? LOAD_SWAPPED : LOAD_FAILED, profileNow() - slotNs);
+    }
+
+    inline void done() noexcept {
+        doneNs = profileNow();
+    }
+
+    // called from run() when the notification is written
+    inline void notify() noexcept {
+        notifyNs = profileNow();
+        loads.fetch_add(1, std::memory_order_relaxed);
+        loadNs.fetch_add(notifyNs - requestNs, std::memory_order_relaxed);
+        serial.fetch_add(1, std::memory_order_release);
+    }
+
+    inline void add(int phase, int64_t ns) noexcept {
+        static const int32_t phaseStage[PHASE_COUNT] = {
+            -1, LOAD_READING, LOAD_PARSING, LOAD_RESAMPLING, LOAD_WARMUP, LOAD_PARTITIONING
+        };
+        phaseNs[phase] += ns;
+        if (phaseStage[phase] >= 0) events.push(slot, phaseStage[phase], ns);
+    }
+
+private:
+    int32_t               slot;         // slot of the running load
+    int64_t               slotNs;       // start of the slot load
+
+    static inline int32_t jobSlot(int32_t job) noexcept {
+        switch (job) {
+            case 1: return SLOT_MODEL_A;
+            case 2: return SLOT_MODEL_B;
+            case 7: return SLOT_IR_A;
+            case 8: return SLOT_IR_B;
+            default: return SLOT_ALL;
+        }
+    }
+};
+
+class DspProfile
+{
+public:
+    std::atomic<uint32_t> serial;
+    uint32_t              blocks;       // blocks in the last window
+    float                 minUs[STAGE_COUNT];
+    float                 meanUs[STAGE_COUNT];
+    float                 maxUs[STAGE_COUNT];
+    uint32_t              misses;       // blocks over the deadline in the last window
+    float                 budgetUs;     // deadline of a block
+    float                 efficiency;   // hidden part of the parallel work, 0..1 or -1
+    TraceRing*            trace;        // audio thread ring or null
+    BlockHistogram        blockTime;    // time of each run() call
+
+    DspProfile() : serial(0), blocks(0), misses(0), budgetUs(0), efficiency(-1),
+        trace(nullptr), count(0), last(0), missCount(0), budgetNs(0), parNs(0) {
+        memset(minUs, 0, sizeof(minUs));
+        memset(meanUs, 0, sizeof(meanUs));
+        memset(maxUs, 0, sizeof(maxUs));
+        memset(cur, 0, sizeof(cur));
+        reset();
+    }
+
+    // called from run() at the start of the first stage
+    inline void begin() noexcept {
+        memset(cur, 0, sizeof(cur));
+        last = profileNow();
+    }
+
+    // the time since the last mark (or begin) belongs to stage
+    inline void mark(int stage) noexcept {
+        const int64_t now = profileNow();
+        cur[stage] += now - last;
+        if (trace) trace->push(DspStageNames[stage], last, now - last);
+        last = now;
+    }
+
+    // called from a helper thread with the time of the tasks it run
+    inline void addParallel(int64_t ns) noexcept {
+        parNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // called from run() with the time of the whole block
+    inline void block(int64_t ns, int64_t deadlineNs) noexcept {
+        blockTime.add(ns);
+        if (ns > deadlineNs) missCount++;
+        budgetNs = deadlineNs;
+    }
+
+    // add the block to the window, publish the window and
+    // return true when it holds size blocks
+    inline bool end(uint32_t size) noexcept {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            sumNs[i] += cur[i];
+            minNs[i] = std::min(minNs[i], cur[i]);
+            maxNs[i] = std::max(maxNs[i], cur[i]);
+        }
+        if (++count < size) return false;
+        serial.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            minUs[i] = minNs[i] * 0.001f;
+            meanUs[i] = sumNs[i] * 0.001f / count;
+            maxUs[i] = maxNs[i] * 0.001f;
+        }
+        const int64_t par = parNs.exchange(0, std::memory_order_relaxed);
+        const int64_t wait = sumNs[STAGE_MODELS_WAIT] + sumNs[STAGE_CONVS_WAIT];
+        efficiency = par > 0 ? std::max(0.0f, 1.0f - float(wait) / par) : -1.0f;
+        misses = missCount;
+        budgetUs = budgetNs * 0.001f;
+        missCount = 0;
+        blocks = count;
+        serial.fetch_add(1, std::memory_order_release);
+        reset();
+        return true;
+    }
+
+private:
+    int64_t  cur[STAGE_COUNT];
+    int64_t  sumNs[STAGE_COUNT];
+    int64_t  minNs[STAGE_COUNT];
+    int64_t  maxNs[STAGE_COUNT];
+    uint32_t count;
+    int64_t  last;
+    uint32_t missCount;
+    int64_t  budgetNs;
+    std::atomic<int64_t> parNs;
+
+    inline void reset() noexcept {
+        count = 0;
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            sumNs[i] = 0;
+            minNs[i] = INT64_MAX;
+            maxNs[i] = 0;
+        }
+    }
+};
+
+class MemoryProfile
+{
+public:
+    std::atomic<int64_t> bytes[MEMORY_COUNT];
+
+    MemoryProfile() {
+        for (int i = 0; i < MEMORY_COUNT; i++) bytes[i].store(0, std::memory_order_relaxed);
+    }
+
+    // called from the worker thread
+    inline void set(int part, size_t n) noexcept {
+        bytes[part].store(static_cast<int64_t>(n), std::memory_order_relaxed);
+    }
+
+    inline int64_t get(int part) const noexcept {
+        return bytes[part].load(std::memory_order_relaxed);
+    }
+
+    // the memory of this instance, without the shared part
+    inline int64_t total() const noexcept {
+        int64_t n = 0;
+        for (int i = 0; i < MEMORY_SHARED; i++) n += get(i);
+        return n;
+    }
+};
+
+class PhaseTimer
+{
+public:
+    PhaseTimer(LoadProfile* p, int phase_) noexcept
+        : profile(p), phase(phase_), t0(p ? profileNow() : 0) {}
+    ~PhaseTimer() { stop(); }
+
+    // add the elapsed time now, the destructor does nothing then
+    inline void stop() noexcept {
+        if (profile) {
+            const int64_t ns = profileNow() - t0;
+            profile->add(phase, ns);
+            if (profile->trace) profile->trace->push(LoadPhaseNames[phase], t0, ns);
+        }
+        profile = nullptr;
+    }
+private:
+    LoadProfile* profile;
+    int          phase;
+    int64_t      t0;
+};
+
+class Profile
+{
+public:
+    LoadProfile load;
+    DspProfile dsp;
+    MemoryProfile memory;
+    const ParallelThreadStats* pro;
+    const ParallelThreadStats* worker;
+
+    Profile() : pro(nullptr), worker(nullptr) {}
+};
+
+} // end namespace ratatouille
+
+typedef struct {
+    const ratatouille::Profile* (*get_profile)(LV2_Handle instance);
+} RatatouilleProfileInterface;
+
+#endif // RATATOUILLE_PROFILE_H_
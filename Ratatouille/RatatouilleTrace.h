@@ -0,0 +1,259 @@
+/*
+ * RatatouilleTrace.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** RatatouilleTrace - optional trace of the processing threads
+ *
+ *  Build with -DRATATOUILLE_TRACE (make TRACE=1) and set the
+ *  environment variable RATATOUILLE_TRACE to a file path. Each traced
+ *  thread then write complete events (name, start, duration) into its
+ *  own lock-free ring, and a writer thread drain the rings every 20ms
+ *  to the file in the Chrome trace JSON format, which could be opened
+ *  with chrome://tracing or https://ui.perfetto.dev.
+ *  Without the define all of it compile to nothing.
+ *
+ *  TraceRing   - single producer/single consumer ring of events.
+ *                When the ring is full, events are dropped and counted.
+ *                Event names must be string literals.
+ *  Tracer      - process wide registry of the rings and the writer.
+ *                add() and remove() allocate and lock, call them
+ *                outside of the real-time thread. add() returns null
+ *                when tracing is disabled.
+ *  TraceScope  - scoped event, does nothing for a null ring.
+ *
+ *  usage:
+ *      TraceRing* ring = Tracer::get().add("pro");
+ *      { TraceScope t(ring, "slot B"); ... }
+ *      // or, when the time stamps are known already
+ *      if (ring) ring->push("conv", startNs, durationNs);
+ *      Tracer::get().remove(ring);
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+#ifndef RATATOUILLE_TRACE_H_
+#define RATATOUILLE_TRACE_H_
+
+namespace ratatouille {
+
+inline int64_t traceNow() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef RATATOUILLE_TRACE
+
+struct TraceEvent {
+    const char* name;
+    int64_t     start;
+    int64_t     duration;
+};
+
+class TraceRing
+{
+public:
+    static const uint32_t capacity = 16384;   // power of two
+
+    const std::string name;
+    const uint32_t    tid;
+
+    TraceRing(const std::string& name_, uint32_t tid_)
+        : name(name_), tid(tid_), head(0), tail(0), dropped(0) {}
+
+    // producer side, real-time safe
+    inline void push(const char* event, int64_t start, int64_t duration) noexcept {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= capacity) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        events[h & (capacity - 1)] = { event, start, duration };
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // consumer side, call f for each pending event
+    template <class F>
+    void drain(F f) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        const uint32_t h = head.load(std::memory_order_acquire);
+        for (; t != h; t++) f(events[t & (capacity - 1)]);
+        tail.store(t, std::memory_order_release);
+    }
+
+    inline uint32_t lost() const noexcept {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+    TraceEvent            events[capacity];
+};
+
+class Tracer
+{
+public:
+    static Tracer& get() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    ~Tracer() {
+        std::unique_lock<std::mutex> lk(mutex);
+        stopWriter(lk);
+        if (file) {
+            fprintf(file, "\n]}\n");
+            fclose(file);
+        }
+    }
+
+    // register a ring for a thread, null when tracing is disabled
+    TraceRing* add(const char* thread) {
+        if (!file) return nullptr;
+        std::unique_lock<std::mutex> lk(mutex);
+        const uint32_t tid = ++lastTid;
+        TraceRing* ring = new TraceRing(std::string(thread) + " #" + std::to_string(tid), tid);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}", separator(), tid, ring->name.c_str());
+        rings.push_back(ring);
+        if (!running) {
+            running = true;
+            writer = std::thread([this]() { run(); });
+        }
+        return ring;
+    }
+
+    // write the pending events of the ring and release it
+    void remove(TraceRing* ring) {
+        if (!ring) return;
+        std::unique_lock<std::mutex> lk(mutex);
+        write(ring);
+        if (ring->lost())
+            fprintf(stderr, "RatatouilleTrace: %s dropped %u events\n", ring->name.c_str(), ring->lost());
+        for (auto it = rings.begin(); it != rings.end(); ++it) {
+            if (*it == ring) {
+                rings.erase(it);
+                break;
+            }
+        }
+        delete ring;
+        if (rings.empty()) stopWriter(lk);
+        fflush(file);
+    }
+
+private:
+    std::mutex              mutex;
+    std::vector<TraceRing*> rings;
+    std::thread             writer;
+    bool                    running;
+    FILE*                   file;
+    uint32_t                lastTid;
+    int64_t                 origin;
+    bool                    first;
+
+    Tracer() : running(false), file(nullptr), lastTid(0), origin(traceNow()), first(true) {
+        const char* path = getenv("RATATOUILLE_TRACE");
+        if (!path || !*path) return;
+        file = fopen(path, "w");
+        if (!file) {
+            fprintf(stderr, "RatatouilleTrace: fail to open %s\n", path);
+            return;
+        }
+        fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    }
+
+    inline const char* separator() {
+        if (first) {
+            first = false;
+            return "\n";
+        }
+        return ",\n";
+    }
+
+    void write(TraceRing* ring) {
+        ring->drain([this, ring](const TraceEvent& e) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f}", separator(), e.name, ring->tid,
+                (e.start - origin) * 0.001, e.duration * 0.001);
+        });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lk(mutex);
+        while (running) {
+            for (auto ring : rings) write(ring);
+            lk.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            lk.lock();
+        }
+    }
+
+    void stopWriter(std::unique_lock<std::mutex>& lk) {
+        if (!running) return;
+        running = false;
+        lk.unlock();
+        writer.join();
+        lk.lock();
+    }
+};
+
+class TraceScope
+{
+public:
+    TraceScope(TraceRing* r, const char* name_) noexcept
+        : ring(r), name(name_), t0(r ? traceNow() : 0) {}
+    ~TraceScope() {
+        if (ring) ring->push(name, t0, traceNow() - t0);
+    }
+private:
+    TraceRing*  ring;
+    const char* name;
+    int64_t     t0;
+};
+
+#else // RATATOUILLE_TRACE
+
+class TraceRing
+{
+public:
+    inline void push(const char*, int64_t, int64_t) noexcept {}
+};
+
+class Tracer
+{
+public:
+    static Tracer& get() {
+        static Tracer tracer;
+        return tracer;
+    }
+    inline TraceRing* add(const char*) { return nullptr; }
+    inline void remove(TraceRing*) {}
+};
+
+class TraceScope
+{
+public:
+    TraceScope(TraceRing*, const char*) noexcept {}
+};
+
+#endif // RATATOUILLE_TRACE
+
+} // end namespace ratatouille
+
+#endif // RATATOUILLE_TRACE_H_
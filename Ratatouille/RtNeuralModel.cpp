@@ -15,6 +15,7 @@ namespace ratatouille {
 RtNeuralModel::RtNeuralModel(std::condition_variable *Sync)
     : model(nullptr), smp(), SyncWait(Sync) {
     needResample = 0;
+    modelMemory = 0;
     isInited = false;
     ready.store(false, std::memory_order_release);
  }
@@ -112,24 +113,55 @@ void RtNeuralModel::get_samplerate(std::string config_file, int *mSampleRate) {
     }
 }
 
+// the number of weights in the layers of a RTNeural json model
+size_t RtNeuralModel::count_weights(const nlohmann::json& config) {
+    if (!config.contains("layers")) return 0;
+    size_t n = 0;
+    for (const auto& layer : config["layers"]) {
+        if (layer.contains("weights")) n += count_numbers(layer["weights"]);
+    }
+    return n;
+}
+
+size_t RtNeuralModel::count_numbers(const nlohmann::json& value) {
+    if (value.is_number()) return 1;
+    size_t n = 0;
+    if (value.is_array()) {
+        for (const auto& v : value) n += count_numbers(v);
+    }
+    return n;
+}
+
 // non rt callback
 bool RtNeuralModel::loadModel() {
     if (!modelFile.empty() && isInited) {
        // fprintf(stderr, "Load file %s\n", modelFile.c_str());
         std::unique_lock<std::mutex> lk(WMutex);
         ready.store(false, std::memory_order_release);
-        SyncWait->wait(lk);
+        {
+            PhaseTimer t(profile, PHASE_SYNC);
+            SyncWait->wait(lk);
+        }
         delete model;
        // fprintf(stderr, "delete model\n");
         model = nullptr;
         modelSampleRate = 0;
         needResample = 0;
+        modelMemory = 0;
+        smp.clear();
         //clearState();
         int32_t warmUpSize = 4096;
         try {
-            get_samplerate(std::string(modelFile), &modelSampleRate);
+            {
+                PhaseTimer t(profile, PHASE_READ);
+                get_samplerate(std::string(modelFile), &modelSampleRate);
+            }
+            PhaseTimer t(profile, PHASE_PARSE);
             std::ifstream jsonStream(std::string(modelFile), std::ifstream::binary);
-            model = RTNeural::json_parser::parseJson<float>(jsonStream).release();
+            nlohmann::json config;
+            jsonStream >> config;
+            model = RTNeural::json_parser::parseJson<float>(config).release();
+            modelMemory = count_weights(config) * sizeof(float);
         } catch (const std::exception&) {
             modelFile = "None";
         }
@@ -137,15 +169,19 @@ bool RtNeuralModel::loadModel() {
         if (model) {
             model->reset();
             if (modelSampleRate <= 0) modelSampleRate = 48000;
-            if (modelSampleRate > fSampleRate) {
-                smp.setup(fSampleRate, modelSampleRate);
-                needResample = 1;
-            } else if (modelSampleRate < fSampleRate) {
-                smp.setup(modelSampleRate, fSampleRate);
-                needResample = 2;
-            } 
+            {
+                PhaseTimer t(profile, PHASE_RESAMPLE);
+                if (modelSampleRate > fSampleRate) {
+                    smp.setup(fSampleRate, modelSampleRate);
+                    needResample = 1;
+                } else if (modelSampleRate < fSampleRate) {
+                    smp.setup(modelSampleRate, fSampleRate);
+                    needResample = 2;
+                } 
+            }
             // fprintf(stderr, "A: %s\n", modelFile.c_str());
 
+            PhaseTimer t(profile, PHASE_WARMUP);
             float* buffer = new float[warmUpSize];
             memset(buffer, 0, warmUpSize * sizeof(float));
 
@@ -171,6 +207,8 @@ void RtNeuralModel::unloadModel() {
     model = nullptr;
     modelSampleRate = 0;
     needResample = 0;
+    modelMemory = 0;
+    smp.clear();
     //clearState();
     ready.store(true, std::memory_order_release);
 }
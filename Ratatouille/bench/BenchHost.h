@@ -0,0 +1,705 @@
+/*
+ * BenchHost.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** BenchHost - minimal headless LV2 host to drive Ratatouille.so
+ *              outside of a DAW
+ *
+ *  BenchHost loads the plugin binary with dlopen() and fetch the
+ *  descriptor by lv2_descriptor(). It provides the features the
+ *  plugin ask for (urid:map, urid:unmap, options with nominal and
+ *  maximum block length, work:schedule and boundedBlockLength),
+ *  connect all ports and could push blocks through run().
+ *
+ *  usage:
+ *      BenchHost host;
+ *      // load the plugin binary and instantiate it
+ *      if (!host.load("./Ratatouille.so", 48000, 128)) exit(1);
+ *      // load a file, this runs silent blocks until the plugin
+ *         echo the file on the NOTIFY port, or the timeout expires
+ *      host.loadFile(host.map(XLV2__MODELFILE), "/path/model.nam");
+ *      // fill host.input(), run a block, read host.output()
+ *      host.run(128);
+ *      // measure a single run() call in nanoseconds
+ *      int64_t ns = host.runTimed(128);
+ *      // restore a session state with all four files, runs silent
+ *         blocks until the plugin report the state on the NOTIFY port
+ *      host.restore(model, model1, ir, ir1);
+ *      // or only send the state and return directly
+ *      host.sendState(model, model1, ir, ir1);
+ *      // the stage timings of run_dsp_() from the NOTIFY port
+ *         of the last run() call, false when not send in this block
+ *      DspTimes t;
+ *      if (host.findDspProfile(&t)) ...
+ *      // the bytes held by the models and convolvers, send a patch:Get
+ *         and run one silent block to get the reply
+ *      MemoryBytes m;
+ *      if (host.queryMemory(&m)) ...
+ *      // the load statistics of the plugin, null when not supported
+ *      const ratatouille::Profile* p = host.profile();
+ *      // release the instance and the plugin binary
+ *      host.unload();
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+
+#include <dlfcn.h>
+
+#include <lv2/core/lv2.h>
+#include <lv2/atom/atom.h>
+#include <lv2/atom/util.h>
+#include <lv2/atom/forge.h>
+#include <lv2/urid/urid.h>
+#include <lv2/patch/patch.h>
+#include <lv2/options/options.h>
+#include <lv2/state/state.h>
+#include <lv2/worker/worker.h>
+#include <lv2/buf-size/buf-size.h>
+
+#include "RatatouilleProfile.h"
+
+#pragma once
+
+#ifndef BENCH_HOST_H_
+#define BENCH_HOST_H_
+
+#define PLUGIN_URI "urn:brummer:ratatouille"
+#define XLV2__MODELFILE "urn:brummer:ratatouille#Neural_Model"
+#define XLV2__MODELFILE1 "urn:brummer:ratatouille#Neural_Model1"
+#define XLV2__IRFILE "urn:brummer:ratatouille#irfile"
+#define XLV2__IRFILE1 "urn:brummer:ratatouille#irfile1"
+
+namespace bench {
+
+// port index and default value as given in Ratatouille.ttl
+enum PortIndex {
+    IN0         = 0,
+    OUT0        = 1,
+    INPUT       = 2,
+    OUTPUT      = 3,
+    BLEND       = 4,
+    CONTROL     = 5,
+    NOTIFY      = 6,
+    MIX         = 7,
+    DELAY       = 8,
+    NORM_A      = 9,
+    NORM_B      = 10,
+    INPUT1      = 11,
+    NORM_SLOT_A = 12,
+    NORM_SLOT_B = 13,
+    DSP_LOAD    = 14,
+    PIPELINE    = 15,
+    LATENCY     = 16,
+    PORT_COUNT  = 17
+};
+
+static const float portDefault[PORT_COUNT] = {
+    0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 0.0f
+};
+
+// the stage timings of run_dsp_() in microseconds, see DspProfile
+struct DspTimes {
+    uint32_t blocks = 0;
+    float    minUs[ratatouille::STAGE_COUNT];
+    float    meanUs[ratatouille::STAGE_COUNT];
+    float    maxUs[ratatouille::STAGE_COUNT];
+};
+
+// the bytes held by each part of the plugin, see MemoryProfile
+struct MemoryBytes {
+    int64_t bytes[ratatouille::MEMORY_COUNT];
+    int64_t total = 0;
+};
+
+class BenchHost
+{
+public:
+    BenchHost()
+        : lib(nullptr)
+         ,desc(nullptr)
+         ,handle(nullptr)
+         ,workerIface(nullptr)
+         ,stateIface(nullptr)
+         ,profileIface(nullptr)
+         ,rate(0)
+         ,maxBlock(0)
+         ,nominalBlock(0)
+         ,runEnter(nullptr)
+         ,runLeave(nullptr)
+         ,wRun(false) {
+        mapFeature.handle = this;
+        mapFeature.map = &BenchHost::mapUri;
+        unmapFeature.handle = this;
+        unmapFeature.unmap = &BenchHost::unmapUri;
+        scheduleFeature.handle = this;
+        scheduleFeature.schedule_work = &BenchHost::scheduleWork;
+        for (uint32_t i = 0; i < PORT_COUNT; i++) controls[i] = portDefault[i];
+        // URID 0 is reserved
+        uris.push_back(std::string());
+        map_host_uris();
+    }
+
+    ~BenchHost() {
+        unload();
+    }
+
+    // load the plugin binary and instantiate the plugin
+    bool load(const char* path, uint32_t sampleRate, uint32_t blockSize, uint32_t maxBlockSize = 0) {
+        unload();
+        lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (!lib) {
+            fprintf(stderr, "BenchHost: fail to load %s: %s\n", path, dlerror());
+            return false;
+        }
+        LV2_Descriptor_Function df = (LV2_Descriptor_Function)dlsym(lib, "lv2_descriptor");
+        if (!df) {
+            fprintf(stderr, "BenchHost: %s has no lv2_descriptor()\n", path);
+            unload();
+            return false;
+        }
+        for (uint32_t i = 0; (desc = df(i)); i++) {
+            if (!strcmp(desc->URI, PLUGIN_URI)) break;
+        }
+        if (!desc) {
+            fprintf(stderr, "BenchHost: %s not found in %s\n", PLUGIN_URI, path);
+            unload();
+            return false;
+        }
+
+        rate = sampleRate;
+        nominalBlock = blockSize;
+        maxBlock = maxBlockSize ? maxBlockSize : blockSize;
+        setup_options();
+
+        LV2_Feature fMap = { LV2_URID__map, &mapFeature };
+        LV2_Feature fUnmap = { LV2_URID__unmap, &unmapFeature };
+        LV2_Feature fSchedule = { LV2_WORKER__schedule, &scheduleFeature };
+        LV2_Feature fOptions = { LV2_OPTIONS__options, options.data() };
+        LV2_Feature fBounded = { LV2_BUF_SIZE__boundedBlockLength, nullptr };
+        const LV2_Feature* features[] = { &fMap, &fUnmap, &fSchedule, &fOptions, &fBounded, nullptr };
+
+        handle = desc->instantiate(desc, rate, "./", features);
+        if (!handle) {
+            fprintf(stderr, "BenchHost: fail to instantiate %s\n", PLUGIN_URI);
+            unload();
+            return false;
+        }
+        if (desc->extension_data) {
+            workerIface = (const LV2_Worker_Interface*)desc->extension_data(LV2_WORKER__interface);
+            stateIface = (const LV2_State_Interface*)desc->extension_data(LV2_STATE__interface);
+            profileIface = (const RatatouilleProfileInterface*)desc->extension_data(XLV2__PROFILE);
+        }
+        startWorker();
+
+        in.assign(maxBlock, 0.0f);
+        out.assign(maxBlock, 0.0f);
+        ctrlBuf.assign(atomCapacity / sizeof(uint64_t), 0);
+        notifyBuf.assign(atomCapacity / sizeof(uint64_t), 0);
+        lv2_atom_forge_init(&forge, &mapFeature);
+        clearControl();
+
+        for (uint32_t i = 0; i < PORT_COUNT; i++) {
+            if (i == IN0) desc->connect_port(handle, i, in.data());
+            else if (i == OUT0) desc->connect_port(handle, i, out.data());
+            else if (i == CONTROL) desc->connect_port(handle, i, ctrlBuf.data());
+            else if (i == NOTIFY) desc->connect_port(handle, i, notifyBuf.data());
+            else desc->connect_port(handle, i, &controls[i]);
+        }
+        if (desc->activate) desc->activate(handle);
+        return true;
+    }
+
+    // deactivate and cleanup the instance, unload the plugin binary
+    void unload() {
+        if (handle) {
+            if (desc->deactivate) desc->deactivate(handle);
+            stopWorker();
+            desc->cleanup(handle);
+            handle = nullptr;
+        }
+        if (lib) {
+            dlclose(lib);
+            lib = nullptr;
+        }
+        desc = nullptr;
+        workerIface = nullptr;
+        stateIface = nullptr;
+        profileIface = nullptr;
+    }
+
+    inline bool isLoaded() const { return handle != nullptr; }
+
+    // map a URI to a URID, the same as the plugin see it
+    LV2_URID map(const char* uri) {
+        return mapUri(this, uri);
+    }
+
+    const char* unmap(LV2_URID urid) {
+        return unmapUri(this, urid);
+    }
+
+    inline float* input() { return in.data(); }
+    inline float* output() { return out.data(); }
+    inline float* control(uint32_t port) { return &controls[port]; }
+    inline uint32_t sampleRate() const { return rate; }
+    inline uint32_t blockSize() const { return nominalBlock; }
+    inline LV2_Handle instance() const { return handle; }
+    inline const LV2_Descriptor* descriptor() const { return desc; }
+
+    // the runtime statistics of the instance, or null when the
+    // plugin don't provide the XLV2__PROFILE extension
+    const ratatouille::Profile* profile() const {
+        return profileIface ? profileIface->get_profile(handle) : nullptr;
+    }
+
+    // queue a patch:Set message with a file path for the next run() call
+    void sendFile(LV2_URID property, const char* path) {
+        LV2_Atom_Forge_Frame frame;
+        lv2_atom_forge_frame_time(&forge, 0);
+        lv2_atom_forge_object(&forge, &frame, 0, patch_Set);
+        lv2_atom_forge_key(&forge, patch_property);
+        lv2_atom_forge_urid(&forge, property);
+        lv2_atom_forge_key(&forge, patch_value);
+        lv2_atom_forge_path(&forge, path, strlen(path) + 1);
+        lv2_atom_forge_pop(&forge, &frame);
+    }
+
+    // queue a patch:Get message for the next run() call
+    void sendGet() {
+        LV2_Atom_Forge_Frame frame;
+        lv2_atom_forge_frame_time(&forge, 0);
+        lv2_atom_forge_object(&forge, &frame, 0, patch_Get);
+        lv2_atom_forge_pop(&forge, &frame);
+    }
+
+    // optional functions called right before and after the plugin
+    // run() call, to check what happens in the real-time context
+    void setRunGuard(void (*enter)(), void (*leave)()) {
+        runEnter = enter;
+        runLeave = leave;
+    }
+
+    // run one block, deliver pending worker responses afterwards
+    inline void run(uint32_t nframes) {
+        prepareNotify();
+        if (runEnter) runEnter();
+        desc->run(handle, nframes);
+        if (runLeave) runLeave();
+        clearControl();
+        deliverResponses();
+    }
+
+    // run one block and return the time spend in run() in nanoseconds
+    inline int64_t runTimed(uint32_t nframes) {
+        prepareNotify();
+        if (runEnter) runEnter();
+        const auto t0 = std::chrono::steady_clock::now();
+        desc->run(handle, nframes);
+        const auto t1 = std::chrono::steady_clock::now();
+        if (runLeave) runLeave();
+        clearControl();
+        deliverResponses();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    }
+
+    // the NOTIFY port content written by the last run() call
+    inline const LV2_Atom_Sequence* notifySequence() const {
+        return (const LV2_Atom_Sequence*)notifyBuf.data();
+    }
+
+    // check the NOTIFY port for a patch:Set message for property,
+    // return true and set value to the file path when found
+    bool findFileEcho(LV2_URID property, std::string* value) const {
+        const LV2_Atom_Sequence* seq = notifySequence();
+        if (seq->atom.type != atom_Sequence) return false;
+        LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
+            if (ev->body.type != atom_Object) continue;
+            const LV2_Atom_Object* obj = (const LV2_Atom_Object*)&ev->body;
+            if (obj->body.otype != patch_Set) continue;
+            const LV2_Atom* prop = NULL;
+            const LV2_Atom* val = NULL;
+            lv2_atom_object_get(obj, patch_property, &prop, patch_value, &val, 0);
+            if (!prop || !val || prop->type != atom_URID || val->type != atom_Path) continue;
+            if (((const LV2_Atom_URID*)prop)->body != property) continue;
+            if (value) *value = (const char*)LV2_ATOM_BODY_CONST(val);
+            return true;
+        }
+        return false;
+    }
+
+    // check the NOTIFY port for the stage timings of run_dsp_(),
+    // the plugin send them about once a second
+    bool findDspProfile(DspTimes* t) const {
+        const LV2_Atom_Sequence* seq = notifySequence();
+        if (seq->atom.type != atom_Sequence) return false;
+        LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
+            if (ev->body.type != atom_Object) continue;
+            const LV2_Atom_Object* obj = (const LV2_Atom_Object*)&ev->body;
+            if (obj->body.otype != xlv2_dsp_profile) continue;
+            const LV2_Atom* blocks = NULL;
+            const LV2_Atom* v[3] = { NULL, NULL, NULL };
+            lv2_atom_object_get(obj, xlv2_dsp_blocks, &blocks, xlv2_dsp_min, &v[0],
+                                xlv2_dsp_mean, &v[1], xlv2_dsp_max, &v[2], 0);
+            if (!blocks || blocks->type != atom_Int) continue;
+            float* dst[3] = { t->minUs, t->meanUs, t->maxUs };
+            bool ok = true;
+            for (int i = 0; i < 3; i++) {
+                if (!v[i] || v[i]->type != atom_Vector) { ok = false; break; }
+                const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)v[i];
+                if (vec->body.child_type != atom_Float) { ok = false; break; }
+                const uint32_t n = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+                if (n != ratatouille::STAGE_COUNT) { ok = false; break; }
+                memcpy(dst[i], vec + 1, n * sizeof(float));
+            }
+            if (!ok) continue;
+            t->blocks = ((const LV2_Atom_Int*)blocks)->body;
+            return true;
+        }
+        return false;
+    }
+
+    // check the NOTIFY port for the memory reply to a patch:Get
+    bool findMemory(MemoryBytes* m) const {
+        const LV2_Atom_Sequence* seq = notifySequence();
+        if (seq->atom.type != atom_Sequence) return false;
+        LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
+            if (ev->body.type != atom_Object) continue;
+            const LV2_Atom_Object* obj = (const LV2_Atom_Object*)&ev->body;
+            if (obj->body.otype != xlv2_memory) continue;
+            const LV2_Atom* bytes = NULL;
+            const LV2_Atom* total = NULL;
+            lv2_atom_object_get(obj, xlv2_memory_bytes, &bytes, xlv2_memory_total, &total, 0);
+            if (!bytes || bytes->type != atom_Vector || !total || total->type != atom_Long) continue;
+            const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)bytes;
+            if (vec->body.child_type != atom_Long) continue;
+            const uint32_t n = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(int64_t);
+            if (n != ratatouille::MEMORY_COUNT) continue;
+            memcpy(m->bytes, vec + 1, n * sizeof(int64_t));
+            m->total = ((const LV2_Atom_Long*)total)->body;
+            return true;
+        }
+        return false;
+    }
+
+    // send a patch:Get and run one silent block to get the memory reply
+    bool queryMemory(MemoryBytes* m) {
+        std::vector<float> save(in);
+        std::fill(in.begin(), in.end(), 0.0f);
+        sendGet();
+        run(nominalBlock);
+        in = save;
+        return findMemory(m);
+    }
+
+    // run silent blocks until the plugin report property on the NOTIFY
+    // port, set value to the reported file path. Returns false when
+    // timeout (in seconds) expires.
+    bool runUntilEcho(LV2_URID property, std::string* value, double timeout = 30.0) {
+        std::vector<float> save(in);
+        std::fill(in.begin(), in.end(), 0.0f);
+        bool ret = false;
+        const auto start = std::chrono::steady_clock::now();
+        while (true) {
+            run(nominalBlock);
+            if (findFileEcho(property, value)) {
+                ret = true;
+                break;
+            }
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout)
+                break;
+            // give the loader thread a chance, like a host in real-time would
+            std::this_thread::sleep_for(std::chrono::microseconds(
+                static_cast<int64_t>(nominalBlock * 1000000.0 / rate)));
+        }
+        in = save;
+        return ret;
+    }
+
+    // send a file to the plugin and run silent blocks until the plugin
+    // report it back on the NOTIFY port. Returns false on load failure
+    // or when timeout (in seconds) expires.
+    bool loadFile(LV2_URID property, const char* path, double timeout = 30.0) {
+        sendFile(property, path);
+        std::string value;
+        if (!runUntilEcho(property, &value, timeout)) {
+            fprintf(stderr, "BenchHost: timeout while loading %s\n", path);
+            return false;
+        }
+        return value == path;
+    }
+
+    // restore a session state by the LV2 state interface, like a host
+    // do when a session is opened. Empty entries are restored as "None".
+    // Returns directly, the plugin load the files in the background.
+    bool sendState(const char* model, const char* model1, const char* ir, const char* ir1) {
+        if (!stateIface || !stateIface->restore) {
+            fprintf(stderr, "BenchHost: plugin don't support state restore\n");
+            return false;
+        }
+        const char* files[4] = { model, model1, ir, ir1 };
+        const char* keys[4] = { XLV2__MODELFILE, XLV2__MODELFILE1, XLV2__IRFILE, XLV2__IRFILE1 };
+        stateKeys.clear();
+        stateValues.clear();
+        for (int i = 0; i < 4; i++) {
+            stateKeys.push_back(map(keys[i]));
+            stateValues.push_back((files[i] && *files[i]) ? files[i] : "None");
+        }
+        if (stateIface->restore(handle, &BenchHost::retrieve, this, 0, nullptr) != LV2_STATE_SUCCESS) {
+            fprintf(stderr, "BenchHost: restore state fail\n");
+            return false;
+        }
+        return true;
+    }
+
+    // restore a session state like sendState(), and run silent blocks
+    // until the plugin report the state on the NOTIFY port.
+    bool restore(const char* model, const char* model1, const char* ir, const char* ir1,
+                 double timeout = 30.0) {
+        if (!sendState(model, model1, ir, ir1)) return false;
+        std::string value;
+        if (!runUntilEcho(stateKeys[0], &value, timeout)) {
+            fprintf(stderr, "BenchHost: timeout while restore state\n");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const uint32_t atomCapacity = 65536;
+
+    void*                        lib;
+    const LV2_Descriptor*        desc;
+    LV2_Handle                   handle;
+    const LV2_Worker_Interface*  workerIface;
+    const LV2_State_Interface*   stateIface;
+    const RatatouilleProfileInterface* profileIface;
+
+    uint32_t                     rate;
+    uint32_t                     maxBlock;
+    uint32_t                     nominalBlock;
+    int32_t                      optNominal;
+    int32_t                      optMax;
+    int32_t                      optMin;
+    float                        optRate;
+
+    float                        controls[PORT_COUNT];
+    std::vector<float>           in;
+    std::vector<float>           out;
+    std::vector<uint64_t>        ctrlBuf;
+    std::vector<uint64_t>        notifyBuf;
+
+    std::mutex                   uriMutex;
+    std::vector<std::string>     uris;
+    std::unordered_map<std::string, LV2_URID> uriMap;
+
+    LV2_URID_Map                 mapFeature;
+    LV2_URID_Unmap               unmapFeature;
+    LV2_Worker_Schedule          scheduleFeature;
+    std::vector<LV2_Options_Option> options;
+    std::vector<LV2_URID>        stateKeys;
+    std::vector<std::string>     stateValues;
+    LV2_Atom_Forge               forge;
+    LV2_Atom_Forge_Frame         seqFrame;
+    void                         (*runEnter)();
+    void                         (*runLeave)();
+
+    // worker thread for work:schedule
+    std::thread                  wThd;
+    std::atomic<bool>            wRun;
+    std::mutex                   wMutex;
+    std::condition_variable      wCond;
+    std::deque<std::vector<uint8_t> > wRequests;
+    std::deque<std::vector<uint8_t> > wResponses;
+
+    LV2_URID                     atom_Sequence;
+    LV2_URID                     atom_Object;
+    LV2_URID                     atom_URID;
+    LV2_URID                     atom_Path;
+    LV2_URID                     atom_Int;
+    LV2_URID                     atom_Float;
+    LV2_URID                     atom_Long;
+    LV2_URID                     atom_Chunk;
+    LV2_URID                     atom_String;
+    LV2_URID                     atom_Vector;
+    LV2_URID                     xlv2_dsp_profile;
+    LV2_URID                     xlv2_dsp_blocks;
+    LV2_URID                     xlv2_dsp_min;
+    LV2_URID                     xlv2_dsp_mean;
+    LV2_URID                     xlv2_dsp_max;
+    LV2_URID                     xlv2_memory;
+    LV2_URID                     xlv2_memory_bytes;
+    LV2_URID                     xlv2_memory_total;
+    LV2_URID                     patch_Get;
+    LV2_URID                     patch_Set;
+    LV2_URID                     patch_property;
+    LV2_URID                     patch_value;
+
+    void map_host_uris() {
+        atom_Sequence =     map(LV2_ATOM__Sequence);
+        atom_Object =       map(LV2_ATOM__Object);
+        atom_URID =         map(LV2_ATOM__URID);
+        atom_Path =         map(LV2_ATOM__Path);
+        atom_Int =          map(LV2_ATOM__Int);
+        atom_Float =        map(LV2_ATOM__Float);
+        atom_Long =         map(LV2_ATOM__Long);
+        atom_Chunk =        map(LV2_ATOM__Chunk);
+        atom_String =       map(LV2_ATOM__String);
+        atom_Vector =       map(LV2_ATOM__Vector);
+        xlv2_dsp_profile =  map(XLV2__DSP_PROFILE);
+        xlv2_dsp_blocks =   map(XLV2__DSP_BLOCKS);
+        xlv2_dsp_min =      map(XLV2__DSP_MIN);
+        xlv2_dsp_mean =     map(XLV2__DSP_MEAN);
+        xlv2_dsp_max =      map(XLV2__DSP_MAX);
+        xlv2_memory =       map(XLV2__MEMORY);
+        xlv2_memory_bytes = map(XLV2__MEMORY_BYTES);
+        xlv2_memory_total = map(XLV2__MEMORY_TOTAL);
+        patch_Get =         map(LV2_PATCH__Get);
+        patch_Set =         map(LV2_PATCH__Set);
+        patch_property =    map(LV2_PATCH__property);
+        patch_value =       map(LV2_PATCH__value);
+    }
+
+    void setup_options() {
+        optNominal = static_cast<int32_t>(nominalBlock);
+        optMax = static_cast<int32_t>(maxBlock);
+        optMin = 1;
+        optRate = static_cast<float>(rate);
+        options.clear();
+        options.push_back({LV2_OPTIONS_INSTANCE, 0, map(LV2_BUF_SIZE__nominalBlockLength),
+                            sizeof(int32_t), atom_Int, &optNominal});
+        options.push_back({LV2_OPTIONS_INSTANCE, 0, map(LV2_BUF_SIZE__maxBlockLength),
+                            sizeof(int32_t), atom_Int, &optMax});
+        options.push_back({LV2_OPTIONS_INSTANCE, 0, map(LV2_BUF_SIZE__minBlockLength),
+                            sizeof(int32_t), atom_Int, &optMin});
+        options.push_back({LV2_OPTIONS_INSTANCE, 0, map("http://lv2plug.in/ns/ext/parameters#sampleRate"),
+                            sizeof(float), atom_Float, &optRate});
+        options.push_back({LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr});
+    }
+
+    // reset the CONTROL port to a empty sequence and prepare the forge for the next messages
+    inline void clearControl() {
+        lv2_atom_forge_set_buffer(&forge, (uint8_t*)ctrlBuf.data(), atomCapacity);
+        // the frame must stay valid while messages are appended
+        lv2_atom_forge_sequence_head(&forge, &seqFrame, 0);
+    }
+
+    // tell the plugin how much space is available on the NOTIFY port
+    inline void prepareNotify() {
+        LV2_Atom_Sequence* seq = (LV2_Atom_Sequence*)notifyBuf.data();
+        seq->atom.type = atom_Chunk;
+        seq->atom.size = atomCapacity - sizeof(LV2_Atom);
+    }
+
+    static LV2_URID mapUri(LV2_URID_Map_Handle h, const char* uri) {
+        BenchHost* self = static_cast<BenchHost*>(h);
+        std::lock_guard<std::mutex> lk(self->uriMutex);
+        auto it = self->uriMap.find(uri);
+        if (it != self->uriMap.end()) return it->second;
+        LV2_URID id = static_cast<LV2_URID>(self->uris.size());
+        self->uris.push_back(uri);
+        self->uriMap[uri] = id;
+        return id;
+    }
+
+    static const char* unmapUri(LV2_URID_Unmap_Handle h, LV2_URID urid) {
+        BenchHost* self = static_cast<BenchHost*>(h);
+        std::lock_guard<std::mutex> lk(self->uriMutex);
+        if (urid == 0 || urid >= self->uris.size()) return nullptr;
+        return self->uris[urid].c_str();
+    }
+
+    // LV2_State_Retrieve_Function, hand out the values set by restore()
+    static const void* retrieve(LV2_State_Handle h, uint32_t key, size_t* size,
+                                uint32_t* type, uint32_t* flags) {
+        BenchHost* self = static_cast<BenchHost*>(h);
+        for (size_t i = 0; i < self->stateKeys.size(); i++) {
+            if (self->stateKeys[i] != key) continue;
+            *size = self->stateValues[i].size() + 1;
+            *type = self->atom_String;
+            *flags = LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE;
+            return self->stateValues[i].c_str();
+        }
+        return nullptr;
+    }
+
+    // work:schedule, called from run(), the work is done in the worker thread
+    static LV2_Worker_Status scheduleWork(LV2_Worker_Schedule_Handle h, uint32_t size, const void* data) {
+        BenchHost* self = static_cast<BenchHost*>(h);
+        if (!self->workerIface) return LV2_WORKER_ERR_UNKNOWN;
+        std::lock_guard<std::mutex> lk(self->wMutex);
+        self->wRequests.emplace_back((const uint8_t*)data, (const uint8_t*)data + size);
+        self->wCond.notify_one();
+        return LV2_WORKER_SUCCESS;
+    }
+
+    static LV2_Worker_Status respond(LV2_Worker_Respond_Handle h, uint32_t size, const void* data) {
+        BenchHost* self = static_cast<BenchHost*>(h);
+        std::lock_guard<std::mutex> lk(self->wMutex);
+        self->wResponses.emplace_back((const uint8_t*)data, (const uint8_t*)data + size);
+        return LV2_WORKER_SUCCESS;
+    }
+
+    void startWorker() {
+        if (!workerIface) return;
+        wRun.store(true, std::memory_order_release);
+        wThd = std::thread([this]() {
+            std::unique_lock<std::mutex> lk(wMutex);
+            while (wRun.load(std::memory_order_acquire)) {
+                wCond.wait(lk, [this]() {
+                    return !wRequests.empty() || !wRun.load(std::memory_order_acquire);});
+                while (!wRequests.empty()) {
+                    std::vector<uint8_t> req(std::move(wRequests.front()));
+                    wRequests.pop_front();
+                    lk.unlock();
+                    workerIface->work(handle, &BenchHost::respond, this, req.size(), req.data());
+                    lk.lock();
+                }
+            }
+        });
+    }
+
+    void stopWorker() {
+        if (!wThd.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lk(wMutex);
+            wRun.store(false, std::memory_order_release);
+            wCond.notify_one();
+        }
+        wThd.join();
+        wRequests.clear();
+        wResponses.clear();
+    }
+
+    void deliverResponses() {
+        if (!workerIface) return;
+        std::deque<std::vector<uint8_t> > responses;
+        {
+            std::lock_guard<std::mutex> lk(wMutex);
+            responses.swap(wResponses);
+        }
+        for (auto& r : responses)
+            workerIface->work_response(handle, r.size(), r.data());
+        if (workerIface->end_run) workerIface->end_run(handle);
+    }
+};
+
+} // end namespace bench
+
+#endif // BENCH_HOST_H_
@@ -0,0 +1,274 @@
+/*
+ * BenchUtil.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** BenchUtil - helpers shared by the Ratatouille benchmarks
+ *
+ *  readWav      - read the first channel of a audio file
+ *  SignalSource - fill blocks with a deterministic test signal,
+ *                 or with the first channel of a audio file
+ *  BlockStats   - collect per block timings and report percentiles
+ *  Background   - busy threads to put load on the CPUs
+ *  writeWav     - write a mono float wav file
+ *  writeIR      - write a decaying noise impulse response
+ *  parseList    - parse a comma separated list of numbers
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sndfile.h>
+
+#pragma once
+
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+namespace bench {
+
+// read the first channel of a audio file, set rate to the sample rate
+inline bool readWav(const std::string& fname, std::vector<float>* data, uint32_t* rate = nullptr) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE* sf = sf_open(fname.c_str(), SFM_READ, &info);
+    if (!sf) {
+        fprintf(stderr, "Unable to open %s\n", fname.c_str());
+        return false;
+    }
+    std::vector<float> frames(info.frames * info.channels);
+    sf_count_t n = sf_readf_float(sf, frames.data(), info.frames);
+    sf_close(sf);
+    if (n <= 0) {
+        fprintf(stderr, "No samples found in %s\n", fname.c_str());
+        return false;
+    }
+    data->resize(n);
+    for (sf_count_t i = 0; i < n; i++) (*data)[i] = frames[i * info.channels];
+    if (rate) *rate = info.samplerate;
+    return true;
+}
+
+class SignalSource
+{
+public:
+    enum {
+        SILENCE,
+        NOISE,
+        SINE,
+        IMPULSE,
+        FILE
+    };
+
+    SignalSource() : kind(NOISE), seed(0x12345678u), phase(0.0), rate(48000), pos(0) {}
+
+    // select a generated signal by name: silence, noise, sine or impulse
+    bool setup(const std::string& name, uint32_t sampleRate) {
+        rate = sampleRate;
+        phase = 0.0;
+        pos = 0;
+        seed = 0x12345678u;
+        if (name == "silence") kind = SILENCE;
+        else if (name == "noise") kind = NOISE;
+        else if (name == "sine") kind = SINE;
+        else if (name == "impulse") kind = IMPULSE;
+        else return false;
+        return true;
+    }
+
+    // use the first channel of a audio file, the file is looped
+    bool open(const std::string& fname) {
+        if (!readWav(fname, &data)) return false;
+        kind = FILE;
+        pos = 0;
+        return true;
+    }
+
+    void fill(float* buf, uint32_t count) {
+        switch (kind) {
+            case SILENCE:
+                memset(buf, 0, count * sizeof(float));
+                break;
+            case NOISE:
+                // deterministic white noise at -12dB
+                for (uint32_t i = 0; i < count; i++) {
+                    seed = seed * 1664525u + 1013904223u;
+                    buf[i] = 0.25f * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+                }
+                break;
+            case SINE:
+                for (uint32_t i = 0; i < count; i++) {
+                    buf[i] = 0.25f * static_cast<float>(std::sin(phase));
+                    phase += 2.0 * M_PI * 440.0 / rate;
+                    if (phase > 2.0 * M_PI) phase -= 2.0 * M_PI;
+                }
+                break;
+            case IMPULSE:
+                memset(buf, 0, count * sizeof(float));
+                // one impulse every second
+                for (uint32_t i = 0; i < count; i++, pos++) {
+                    if (pos >= rate) pos = 0;
+                    if (pos == 0) buf[i] = 0.5f;
+                }
+                break;
+            case FILE:
+                for (uint32_t i = 0; i < count; i++) {
+                    buf[i] = data[pos];
+                    if (++pos >= data.size()) pos = 0;
+                }
+                break;
+        }
+    }
+
+private:
+    int                kind;
+    uint32_t           seed;
+    double             phase;
+    uint32_t           rate;
+    size_t             pos;
+    std::vector<float> data;
+};
+
+class BlockStats
+{
+public:
+    void reserve(size_t n) { times.reserve(n); }
+    void clear() { times.clear(); sorted = false; }
+    inline void add(int64_t ns) { times.push_back(ns); sorted = false; }
+    size_t count() const { return times.size(); }
+
+    // percentile p in [0,1] in nanoseconds
+    int64_t percentile(double p) {
+        if (times.empty()) return 0;
+        sort();
+        size_t idx = static_cast<size_t>(std::ceil(p * times.size()));
+        if (idx > 0) idx--;
+        return times[std::min(idx, times.size() - 1)];
+    }
+
+    int64_t max() {
+        if (times.empty()) return 0;
+        sort();
+        return times.back();
+    }
+
+    // number of blocks which took longer than ns
+    size_t countAbove(double ns) const {
+        size_t n = 0;
+        for (auto t : times) if (t > ns) n++;
+        return n;
+    }
+
+    double mean() const {
+        if (times.empty()) return 0.0;
+        double sum = 0.0;
+        for (auto t : times) sum += t;
+        return sum / times.size();
+    }
+
+private:
+    std::vector<int64_t> times;
+    bool sorted = false;
+
+    void sort() {
+        if (!sorted) std::sort(times.begin(), times.end());
+        sorted = true;
+    }
+};
+
+// busy threads, one per CPU by default, to measure on a loaded system.
+// The threads inherit the scheduling policy of the calling thread.
+class Background
+{
+public:
+    Background() : running(false) {}
+    ~Background() { stop(); }
+
+    void start(unsigned count = 0) {
+        running.store(true, std::memory_order_release);
+        const unsigned n = count ? count : std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < n; i++) {
+            threads.emplace_back([this]() {
+                volatile double x = 1.0;
+                while (running.load(std::memory_order_relaxed)) {
+                    for (int j = 0; j < 1000; j++) x = x * 1.0000001 + 0.0000001;
+                }
+            });
+        }
+    }
+
+    void stop() {
+        running.store(false, std::memory_order_release);
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+
+private:
+    std::atomic<bool> running;
+    std::vector<std::thread> threads;
+};
+
+// the real-time budget for one block in nanoseconds
+inline double blockBudget(uint32_t blockSize, uint32_t sampleRate) {
+    return blockSize * 1e9 / sampleRate;
+}
+
+// write a mono 32 bit float wav file
+inline bool writeWav(const std::string& fname, const float* data, size_t frames, uint32_t sampleRate) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    info.samplerate = sampleRate;
+    info.channels = 1;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    SNDFILE* sf = sf_open(fname.c_str(), SFM_WRITE, &info);
+    if (!sf) {
+        fprintf(stderr, "Unable to write %s\n", fname.c_str());
+        return false;
+    }
+    const sf_count_t n = sf_writef_float(sf, data, frames);
+    sf_close(sf);
+    return n == static_cast<sf_count_t>(frames);
+}
+
+// write a decaying noise impulse response, about 60dB down at the end
+inline bool writeIR(const std::string& fname, uint32_t length, uint32_t sampleRate) {
+    std::vector<float> ir(length);
+    SignalSource noise;
+    noise.setup("noise", sampleRate);
+    noise.fill(ir.data(), length);
+    const double decay = std::log(0.001) / length;
+    for (uint32_t i = 0; i < length; i++) ir[i] *= 4.0f * static_cast<float>(std::exp(decay * i));
+    return writeWav(fname, ir.data(), length, sampleRate);
+}
+
+// parse a comma separated list of positive numbers
+inline bool parseList(const char* arg, std::vector<uint32_t>* list) {
+    list->clear();
+    std::string s(arg);
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        uint32_t v = strtoul(s.substr(start, end - start).c_str(), nullptr, 10);
+        if (!v) return false;
+        list->push_back(v);
+        start = end + 1;
+    }
+    return !list->empty();
+}
+
+} // end namespace bench
+
+#endif // BENCH_UTIL_H_
@@ -0,0 +1,230 @@
+/*
+ * ConvolverBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_convbench - compare SingleThreadConvolver and
+ *                          DoubleThreadConvolver
+ *
+ *  For every IR length a decaying noise impulse response is written
+ *  to a temporary wav file at the benchmark sample rate, so that
+ *  configure() runs the same path as in the plugin, without resampling.
+ *  Then for every block size a fresh convolver is configured and
+ *  blocks of noise are processed by compute().
+ *  Reported is the time configure() takes, and the mean and worst
+ *  time per compute() call, absolute and as fraction of the
+ *  real-time budget (block size / sample rate).
+ *
+ *  usage:
+ *      Ratatouille_convbench [options]
+ *        -r --rate    Hz       sample rate (default 48000)
+ *        -l --lengths list     IR lengths in samples
+ *                              (default 256,1024,4096,16384,65536,262144,1048576,2000000)
+ *        -b --sizes   list     block sizes
+ *                              (default 16,32,...,4096 and 48,100,333,1000,1500)
+ *        -t --seconds sec      audio processed per combination (default 2)
+ *        -c --conv    name     single, double or both (default both)
+ *        -o --csv     path     write the result as CSV to path
+ *        -F --fifo             run the benchmark thread with SCHED_FIFO
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "fftconvolver.cc"
+
+#include "BenchUtil.h"
+
+namespace bench {
+
+struct ConvOptions {
+    uint32_t    rate = 48000;
+    std::vector<uint32_t> lengths = {256, 1024, 4096, 16384, 65536, 262144, 1048576, 2000000};
+    std::vector<uint32_t> sizes = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096,
+                                   48, 100, 333, 1000, 1500};
+    double      seconds = 2.0;
+    bool        single = true;
+    bool        dual = true;
+    std::string csv;
+    bool        fifo = false;
+};
+
+struct ConvResult {
+    double configureMs;
+    double meanUs;
+    double p99Us;
+    double maxUs;
+    double budgetUs;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -r --rate    Hz       sample rate (default 48000)\n"
+        "  -l --lengths list     IR lengths in samples\n"
+        "                        (default 256,1024,4096,16384,65536,262144,1048576,2000000)\n"
+        "  -b --sizes   list     block sizes\n"
+        "                        (default 16,32,...,4096 and 48,100,333,1000,1500)\n"
+        "  -t --seconds sec      audio processed per combination (default 2)\n"
+        "  -c --conv    name     single, double or both (default both)\n"
+        "  -o --csv     path     write the result as CSV to path\n"
+        "  -F --fifo             run the benchmark thread with SCHED_FIFO\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, ConvOptions* o) {
+    static const struct option longOptions[] = {
+        {"rate",    required_argument, 0, 'r'},
+        {"lengths", required_argument, 0, 'l'},
+        {"sizes",   required_argument, 0, 'b'},
+        {"seconds", required_argument, 0, 't'},
+        {"conv",    required_argument, 0, 'c'},
+        {"csv",     required_argument, 0, 'o'},
+        {"fifo",    no_argument,       0, 'F'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "r:l:b:t:c:o:Fh", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'l': if (!parseList(optarg, &o->lengths)) return false; break;
+            case 'b': if (!parseList(optarg, &o->sizes)) return false; break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'c':
+                o->single = !strcmp(optarg, "single") || !strcmp(optarg, "both");
+                o->dual = !strcmp(optarg, "double") || !strcmp(optarg, "both");
+                if (!o->single && !o->dual) return false;
+                break;
+            case 'o': o->csv = optarg; break;
+            case 'F': o->fifo = true; break;
+            default: return false;
+        }
+    }
+    if (!o->rate || o->seconds <= 0.0) return false;
+    return true;
+}
+
+static void setFifo() {
+    sched_param sch_params;
+    sch_params.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sch_params)) {
+        fprintf(stderr, "Ratatouille_convbench: fail to set SCHED_FIFO, continue with default policy\n");
+    }
+}
+
+// configure conv with the IR file, run seconds of noise through it
+template <class C>
+static bool measure(C& conv, const std::string& fname, uint32_t rate, uint32_t block,
+                    double seconds, ConvResult* res) {
+    conv.set_samplerate(rate);
+    conv.set_buffersize(block);
+    const auto t0 = std::chrono::steady_clock::now();
+    const bool ok = conv.configure(fname, 1.0, 0, 0, 0, 0, 0);
+    const auto t1 = std::chrono::steady_clock::now();
+    if (!ok) return false;
+    conv.start(0, 0);
+    res->configureMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+    std::vector<float> in(block);
+    std::vector<float> out(block);
+    SignalSource source;
+    source.setup("noise", rate);
+    const uint32_t blocks = std::max<uint32_t>(100, static_cast<uint32_t>(seconds * rate / block));
+    const uint32_t warmup = std::max<uint32_t>(10, blocks / 20);
+    BlockStats stats;
+    stats.reserve(blocks);
+    for (uint32_t i = 0; i < warmup + blocks; i++) {
+        source.fill(in.data(), block);
+        const auto s0 = std::chrono::steady_clock::now();
+        conv.compute(block, in.data(), out.data());
+        const auto s1 = std::chrono::steady_clock::now();
+        if (i >= warmup)
+            stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(s1 - s0).count());
+    }
+    conv.set_not_runnable();
+    conv.cleanup();
+    res->meanUs = stats.mean() * 0.001;
+    res->p99Us = stats.percentile(0.99) * 0.001;
+    res->maxUs = stats.max() * 0.001;
+    res->budgetUs = blockBudget(block, rate) * 0.001;
+    return true;
+}
+
+static void printRow(FILE* csv, const char* name, uint32_t length, uint32_t block,
+                     const ConvResult& r) {
+    printf("  %-7s %8u %6u %12.3f %10.2f %10.2f %10.2f %8.2f%% %8.2f%%\n",
+        name, length, block, r.configureMs, r.meanUs, r.p99Us, r.maxUs,
+        100.0 * r.meanUs / r.budgetUs, 100.0 * r.maxUs / r.budgetUs);
+    if (csv) {
+        fprintf(csv, "%s,%u,%u,%.3f,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f\n",
+            name, length, block, r.configureMs, r.meanUs, r.p99Us, r.maxUs,
+            r.budgetUs, r.meanUs / r.budgetUs, r.maxUs / r.budgetUs);
+        fflush(csv);
+    }
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::ConvOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    char dir[] = "/tmp/Ratatouille_convbench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Ratatouille_convbench: fail to create temporary directory\n");
+        return 1;
+    }
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_convbench: fail to open %s\n", o.csv.c_str());
+            rmdir(dir);
+            return 1;
+        }
+        fprintf(csv, "convolver,ir_length,block,configure_ms,mean_us,p99_us,max_us,"
+                     "budget_us,mean_load,max_load\n");
+    }
+    if (o.fifo) bench::setFifo();
+
+    printf("Ratatouille_convbench: %u Hz\n", o.rate);
+    printf("  %-7s %8s %6s %12s %10s %10s %10s %9s %9s\n", "conv", "ir", "block",
+        "config (ms)", "mean (us)", "p99 (us)", "max (us)", "mean", "max");
+    int ret = 0;
+    for (auto length : o.lengths) {
+        const std::string fname = std::string(dir) + "/ir_" + std::to_string(length) + ".wav";
+        if (!bench::writeIR(fname, length, o.rate)) {
+            ret = 1;
+            continue;
+        }
+        for (auto block : o.sizes) {
+            bench::ConvResult r;
+            if (o.single) {
+                SingleThreadConvolver conv;
+                if (bench::measure(conv, fname, o.rate, block, o.seconds, &r))
+                    bench::printRow(csv, "single", length, block, r);
+                else ret = 1;
+            }
+            if (o.dual) {
+                DoubleThreadConvolver conv;
+                if (bench::measure(conv, fname, o.rate, block, o.seconds, &r))
+                    bench::printRow(csv, "double", length, block, r);
+                else ret = 1;
+            }
+        }
+        unlink(fname.c_str());
+    }
+    rmdir(dir);
+    if (csv) fclose(csv);
+    return ret;
+}
@@ -0,0 +1,236 @@
+/*
+ * ForkJoinTest.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_forkjointest - check the adaptive placement of ForkJoin
+ *
+ *  Two tasks play the model slots, they spin for a given time, and the
+ *  main thread run them back to back as a fork/join group with one
+ *  helper thread, like Xratatouille::run_dsp_() does. The cost of the
+ *  tasks is changed in phases:
+ *      warm    A 200us, B 150us, B should run on the helper
+ *      spike   one hand over of B take 5ms, that give a slow sample
+ *              of the hand over cost
+ *      shrink  B 2us, B should run inline
+ *      grow    B 150us again, B must go back to the helper, the slow
+ *              sample must not keep it inline
+ *      swap    A 60us, B 200us, the more expensive B should be kept
+ *              for the main thread and A go to the helper
+ *
+ *  While B runs inline the hand over cost must be measured again
+ *  (ForkJoin::probeBlocks), that is checked on any system. The checks
+ *  of the placement need a second core and are skipped on single core
+ *  systems.
+ *
+ *  At last the priority case: the main thread run SCHED_FIFO and a
+ *  second ForkJoin get a helper with a lower priority on the same core,
+ *  so the helper only get the CPU when the main thread sleeps. The hand
+ *  over must not wait for the helper, else the main thread hang, a
+ *  watchdog fail the test then. It's skipped when SCHED_FIFO isn't
+ *  permitted.
+ *
+ *  usage:
+ *      Ratatouille_forkjointest
+ *  exit code 0 when all checks pass.
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "ForkJoin.h"
+
+namespace bench {
+
+static inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void spin(int64_t ns) {
+    const int64_t end = nowNs() + ns;
+    while (nowNs() < end) {}
+}
+
+enum { TASK_A, TASK_B };
+
+struct Tasks {
+    int64_t costA = 200000;
+    int64_t costB = 150000;
+    // the next run of B on the helper take that long, once
+    int64_t spikeB = 0;
+    ForkJoin* jobs = nullptr;
+
+    void runA() { spin(costA); }
+    void runB() {
+        if (spikeB && jobs->isOffloaded(TASK_B)) {
+            spin(spikeB);
+            spikeB = 0;
+        } else {
+            spin(costB);
+        }
+    }
+};
+
+struct Phase {
+    uint32_t offloadA = 0;
+    uint32_t offloadB = 0;
+    uint32_t handshakeChanges = 0;
+};
+
+// run n groups, count the hand overs in the last tail groups
+static Phase runGroups(ForkJoin& jobs, uint32_t n, uint32_t tail) {
+    static const uint32_t group[] = {TASK_A, TASK_B};
+    Phase p;
+    int64_t handshake = jobs.getHandshake();
+    for (uint32_t i = 0; i < n; i++) {
+        jobs.fork(group, 2);
+        if (i >= n - tail) {
+            p.offloadA += jobs.isOffloaded(TASK_A);
+            p.offloadB += jobs.isOffloaded(TASK_B);
+        }
+        jobs.join();
+        if (jobs.getHandshake() != handshake) p.handshakeChanges++;
+        handshake = jobs.getHandshake();
+    }
+    return p;
+}
+
+static bool check(bool ok, const char* what) {
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static void watchdog(int) {
+    static const char msg[] = "  priority: the hand over hang\nRatatouille_forkjointest: FAIL\n";
+    if (write(STDOUT_FILENO, msg, sizeof(msg) - 1)) {}
+    _exit(1);
+}
+
+struct Short {
+    void run() { spin(20000); }
+};
+
+// run the groups with the helper on the own core at a lower priority,
+// return false when SCHED_FIFO isn't permitted
+static bool priorityCase() {
+    #if defined(__linux__)
+    pthread_t self = pthread_self();
+    cpu_set_t old, one;
+    int policy;
+    sched_param oldParam, param;
+    const int cpu = sched_getcpu();
+    if (cpu < 0 || pthread_getaffinity_np(self, sizeof(old), &old) ||
+        pthread_getschedparam(self, &policy, &oldParam)) return false;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if (pthread_setaffinity_np(self, sizeof(one), &one)) return false;
+    param.sched_priority = 50;
+    if (pthread_setschedparam(self, SCHED_FIFO, &param)) {
+        pthread_setaffinity_np(self, sizeof(old), &old);
+        return false;
+    }
+    Short tasks;
+    ForkJoin jobs;
+    jobs.setHelpers(1);
+    jobs.setAdaptive(false);
+    jobs.setThreadName("forkjoinprio");
+    // the helper inherit the core and get priority 50 / 5
+    jobs.start();
+    jobs.setPriority(50, SCHED_FIFO);
+    jobs.set<TASK_A, Short, &Short::run>(&tasks, "A");
+    jobs.set<TASK_B, Short, &Short::run>(&tasks, "B");
+    fflush(stdout);
+    signal(SIGALRM, watchdog);
+    alarm(20);
+    static const uint32_t group[] = {TASK_A, TASK_B};
+    uint32_t offloaded = 0;
+    for (uint32_t i = 0; i < 2000; i++) {
+        jobs.fork(group, 2);
+        offloaded += jobs.isOffloaded(TASK_B);
+        jobs.join();
+    }
+    alarm(0);
+    jobs.stop();
+    pthread_setschedparam(self, policy, &oldParam);
+    pthread_setaffinity_np(self, sizeof(old), &old);
+    printf("  prio    B on the helper %4u/%u\n", offloaded, 2000u);
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+} // namespace bench
+
+int main() {
+    const bool multiCore = std::thread::hardware_concurrency() > 1;
+    bench::Tasks tasks;
+    ForkJoin jobs;
+    tasks.jobs = &jobs;
+    jobs.setHelpers(1);
+    jobs.setThreadName("forkjoin");
+    jobs.start();
+    jobs.set<bench::TASK_A, bench::Tasks, &bench::Tasks::runA>(&tasks, "A");
+    jobs.set<bench::TASK_B, bench::Tasks, &bench::Tasks::runB>(&tasks, "B");
+
+    printf("Ratatouille_forkjointest: %u cores, probe every %u groups\n",
+        std::thread::hardware_concurrency(), ForkJoin::probeBlocks);
+    bool ok = true;
+    const uint32_t tail = 1000;
+
+    const bench::Phase warm = bench::runGroups(jobs, 2000, tail);
+    printf("  warm    B on the helper %4u/%u, hand over %.1f us\n",
+        warm.offloadB, tail, jobs.getHandshake() * 1e-3);
+
+    tasks.spikeB = 5000000;
+    bench::runGroups(jobs, 1, 1);
+    printf("  spike   hand over %.1f us\n", jobs.getHandshake() * 1e-3);
+
+    tasks.costB = 2000;
+    const bench::Phase shrink = bench::runGroups(jobs, 2000, tail);
+    printf("  shrink  B on the helper %4u/%u, hand over %.1f us\n",
+        shrink.offloadB, tail, jobs.getHandshake() * 1e-3);
+    ok &= bench::check(shrink.handshakeChanges > 0,
+        "hand over measured again while B runs inline");
+
+    tasks.costB = 150000;
+    const bench::Phase grow = bench::runGroups(jobs, 4000, tail);
+    printf("  grow    B on the helper %4u/%u, hand over %.1f us\n",
+        grow.offloadB, tail, jobs.getHandshake() * 1e-3);
+
+    tasks.costA = 60000;
+    tasks.costB = 200000;
+    const bench::Phase swap = bench::runGroups(jobs, 2000, tail);
+    printf("  swap    A on the helper %4u/%u, B %u/%u\n",
+        swap.offloadA, tail, swap.offloadB, tail);
+
+    if (multiCore) {
+        ok &= bench::check(warm.offloadB > tail / 2, "warm: B run on the helper");
+        ok &= bench::check(shrink.offloadB < tail / 4, "shrink: B run inline");
+        ok &= bench::check(grow.offloadB > tail / 2, "grow: B back on the helper after the slow sample");
+        ok &= bench::check(swap.offloadA > tail / 2 && swap.offloadB == 0,
+            "swap: the more expensive B kept for the main thread");
+    } else {
+        printf("  single core, skip the placement checks\n");
+    }
+    jobs.stop();
+
+    if (bench::priorityCase())
+        ok &= bench::check(true, "priority: a lower priority helper on the same core");
+    else
+        printf("  SCHED_FIFO not permitted, skip the priority case\n");
+
+    printf("Ratatouille_forkjointest: %s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
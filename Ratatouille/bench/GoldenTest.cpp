@@ -0,0 +1,349 @@
+/*
+ * GoldenTest.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_golden - compare the plugin output against
+ *                       reference renders
+ *
+ *  Every case is rendered with a new plugin instance: the files of the
+ *  case are loaded by a state restore, one second of silence is run,
+ *  then the input signal (noise, sine and impulse, see SignalSource)
+ *  is processed for two seconds in blocks of 128 frames, while the
+ *  controls are automated in a fixed way:
+ *      input gain A    -12dB -> +6dB ramp
+ *      input gain B    +6dB -> -6dB ramp
+ *      output gain     0dB -> -6dB -> 0dB
+ *      blend           0 -> 1 ramp
+ *      mix             1 -> 0 ramp
+ *      delta delay     -32, 0, +32 for a third each
+ *  Each case is done at 48kHz and 44.1kHz, so the models (48kHz) and
+ *  the IRs (44.1kHz and 48kHz) run once with and once without resampling.
+ *
+ *  cases:
+ *      dry       no model, no IR (dcblocker only)
+ *      slot-a    NAM WaveNet in slot A
+ *      slot-b    LSTM in slot B (parallel processor)
+ *      blend     NAM WaveNet in slot A, GRU in slot B
+ *      ir-a      IR in the first convolver
+ *      ir-mix    IRs in both convolvers (parallel processor)
+ *      full      all of them, slot A normalised
+ *
+ *  Record the references with a build you trust:
+ *      Ratatouille_golden -R -d golden
+ *  this write the synthetic models of ModelZoo, the IRs and one wav file
+ *  per render to the directory. Later runs compare against them:
+ *      Ratatouille_golden -d golden
+ *
+ *  Tolerances, a render pass when both hold:
+ *      max abs    the largest sample difference, default 1e-4 (-80dBFS).
+ *                 Changes which only reorder float operations (SIMD,
+ *                 loop fusion, other FFT partitions) stay far below.
+ *      snr        reference energy / difference energy, default 80dB.
+ *                 A changed model activation approximation or filter
+ *                 coefficient shows up here first.
+ *  Changes to the threading must be bit exact, the column "exact" show
+ *  it. A render where the parallel processor dropped a block
+ *  is not comparable and counts as failed.
+ *
+ *  usage:
+ *      Ratatouille_golden [options]
+ *        -p --plugin  path     plugin binary (default ./Ratatouille.so)
+ *        -d --dir     path     reference directory (default ./golden)
+ *        -R --record           write the references instead of comparing
+ *        -c --case    name     only run cases which contain name
+ *        -a --maxabs  value    max abs tolerance (default 1e-4)
+ *        -s --snr     dB       minimal snr (default 80)
+ *        -O --out     path     write the renders of this run to path
+ *        -o --csv     path     write the result as CSV to path
+ */
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include <limits>
+
+#include "BenchHost.h"
+#include "BenchUtil.h"
+#include "ModelZoo.h"
+
+namespace bench {
+
+static const uint32_t goldenBlock = 128;
+static const double   goldenSeconds = 2.0;
+static const double   goldenPreroll = 1.0;
+static const uint32_t goldenRates[] = { 48000, 44100 };
+static const char* const goldenInputs[] = { "noise", "sine", "impulse" };
+
+struct GoldenOptions {
+    std::string plugin = "./Ratatouille.so";
+    std::string dir = "./golden";
+    bool        record = false;
+    std::string filter;
+    double      maxAbs = 1e-4;
+    double      snr = 80.0;
+    std::string out;
+    std::string csv;
+};
+
+struct GoldenCase {
+    const char* name;
+    const char* modelA;
+    const char* modelB;
+    const char* irA;
+    const char* irB;
+    bool        normSlotA;
+};
+
+static const GoldenCase goldenCases[] = {
+    { "dry",    "",                "",        "",          "",          false },
+    { "slot-a", "wavenet-feather", "",        "",          "",          false },
+    { "slot-b", "",                "lstm-16", "",          "",          false },
+    { "blend",  "wavenet-nano",    "gru-16",  "",          "",          false },
+    { "ir-a",   "",                "",        "ir-a.wav",  "",          false },
+    { "ir-mix", "",                "",        "ir-a.wav",  "ir-b.wav",  false },
+    { "full",   "wavenet-feather", "lstm-16", "ir-a.wav",  "ir-b.wav",  true  }
+};
+
+// the IRs written to the reference directory
+static const struct { const char* name; uint32_t length; uint32_t rate; } goldenIRs[] = {
+    { "ir-a.wav", 22050, 44100 },
+    { "ir-b.wav", 12000, 48000 }
+};
+
+struct GoldenDiff {
+    double maxAbs = 0.0;
+    double snr = std::numeric_limits<double>::infinity();
+    bool   exact = true;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p --plugin  path     plugin binary (default ./Ratatouille.so)\n"
+        "  -d --dir     path     reference directory (default ./golden)\n"
+        "  -R --record           write the references instead of comparing\n"
+        "  -c --case    name     only run cases which contain name\n"
+        "  -a --maxabs  value    max abs tolerance (default 1e-4)\n"
+        "  -s --snr     dB       minimal snr (default 80)\n"
+        "  -O --out     path     write the renders of this run to path\n"
+        "  -o --csv     path     write the result as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, GoldenOptions* o) {
+    static const struct option longOptions[] = {
+        {"plugin",  required_argument, 0, 'p'},
+        {"dir",     required_argument, 0, 'd'},
+        {"record",  no_argument,       0, 'R'},
+        {"case",    required_argument, 0, 'c'},
+        {"maxabs",  required_argument, 0, 'a'},
+        {"snr",     required_argument, 0, 's'},
+        {"out",     required_argument, 0, 'O'},
+        {"csv",     required_argument, 0, 'o'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:d:Rc:a:s:O:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'p': o->plugin = optarg; break;
+            case 'd': o->dir = optarg; break;
+            case 'R': o->record = true; break;
+            case 'c': o->filter = optarg; break;
+            case 'a': o->maxAbs = strtod(optarg, nullptr); break;
+            case 's': o->snr = strtod(optarg, nullptr); break;
+            case 'O': o->out = optarg; break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return !o->dir.empty() && o->maxAbs >= 0.0;
+}
+
+// the path of a resource in the reference directory, ModelZoo write
+// WaveNets as *.nam and the other models as *.json
+static std::string resource(const std::string& dir, const char* name) {
+    if (!*name) return std::string();
+    const std::string n(name);
+    if (n.find(".wav") != std::string::npos) return dir + "/" + n;
+    return dir + "/" + n + (n.compare(0, 7, "wavenet") == 0 ? ".nam" : ".json");
+}
+
+static std::string renderName(const GoldenCase& c, uint32_t rate, const char* input) {
+    return std::string(c.name) + "-" + std::to_string(rate) + "-" + input + ".wav";
+}
+
+// write the models and IRs used by the cases
+static bool writeResources(const std::string& dir) {
+    mkdir(dir.c_str(), 0755);
+    ModelZoo zoo;
+    if (!zoo.write(dir, 48000)) return false;
+    for (auto& ir : goldenIRs)
+        if (!writeIR(dir + "/" + ir.name, ir.length, ir.rate)) return false;
+    return true;
+}
+
+// set the controls for the position t (0 - 1) in the render
+static void automate(BenchHost& host, double t) {
+    *host.control(INPUT) = static_cast<float>(-12.0 + 18.0 * t);
+    *host.control(INPUT1) = static_cast<float>(6.0 - 12.0 * t);
+    *host.control(OUTPUT) = static_cast<float>(-6.0 * std::sin(M_PI * t));
+    *host.control(BLEND) = static_cast<float>(t);
+    *host.control(MIX) = static_cast<float>(1.0 - t);
+    *host.control(DELAY) = t < 1.0 / 3.0 ? -32.0f : (t < 2.0 / 3.0 ? 0.0f : 32.0f);
+}
+
+// render one case with a new instance, return false on load failure
+// or when the parallel processor dropped a block
+static bool render(const GoldenOptions& o, const GoldenCase& c, uint32_t rate,
+                   const char* input, std::vector<float>* out) {
+    BenchHost host;
+    if (!host.load(o.plugin.c_str(), rate, goldenBlock)) return false;
+    const std::string files[4] = {
+        resource(o.dir, c.modelA), resource(o.dir, c.modelB),
+        resource(o.dir, c.irA), resource(o.dir, c.irB)
+    };
+    if (!files[0].empty() || !files[1].empty() || !files[2].empty() || !files[3].empty()) {
+        if (!host.restore(files[0].c_str(), files[1].c_str(), files[2].c_str(), files[3].c_str()))
+            return false;
+        // let the worker finish after the notification
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    *host.control(NORM_SLOT_A) = c.normSlotA ? 1.0f : 0.0f;
+
+    std::fill(host.input(), host.input() + goldenBlock, 0.0f);
+    const uint32_t preroll = static_cast<uint32_t>(goldenPreroll * rate / goldenBlock);
+    for (uint32_t i = 0; i < preroll; i++) host.run(goldenBlock);
+
+    const ratatouille::Profile* profile = host.profile();
+    const uint32_t dropped = profile && profile->pro ?
+        profile->pro->dropped.load(std::memory_order_relaxed) : 0;
+    SignalSource source;
+    source.setup(input, rate);
+    const uint32_t blocks = static_cast<uint32_t>(goldenSeconds * rate / goldenBlock);
+    out->resize(blocks * goldenBlock);
+    for (uint32_t i = 0; i < blocks; i++) {
+        automate(host, static_cast<double>(i) / blocks);
+        source.fill(host.input(), goldenBlock);
+        host.run(goldenBlock);
+        memcpy(out->data() + i * goldenBlock, host.output(), goldenBlock * sizeof(float));
+    }
+    if (profile && profile->pro &&
+            profile->pro->dropped.load(std::memory_order_relaxed) != dropped) {
+        fprintf(stderr, "Ratatouille_golden: %s dropped a block\n", c.name);
+        return false;
+    }
+    return true;
+}
+
+static GoldenDiff compare(const std::vector<float>& ref, const std::vector<float>& cur) {
+    GoldenDiff d;
+    if (ref.size() != cur.size()) {
+        d.exact = false;
+        d.maxAbs = std::numeric_limits<double>::infinity();
+        d.snr = -std::numeric_limits<double>::infinity();
+        return d;
+    }
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = 0; i < ref.size(); i++) {
+        const double e = static_cast<double>(cur[i]) - ref[i];
+        // NaN compare false, so count it as a difference
+        if (!(cur[i] == ref[i])) d.exact = false;
+        if (!std::isfinite(e)) {
+            d.maxAbs = std::numeric_limits<double>::infinity();
+            d.snr = -std::numeric_limits<double>::infinity();
+            return d;
+        }
+        d.maxAbs = std::max(d.maxAbs, std::fabs(e));
+        signal += static_cast<double>(ref[i]) * ref[i];
+        noise += e * e;
+    }
+    if (noise > 0.0) d.snr = signal > 0.0 ? 10.0 * std::log10(signal / noise) :
+                                            -std::numeric_limits<double>::infinity();
+    return d;
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::GoldenOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    if (o.record && !bench::writeResources(o.dir)) {
+        fprintf(stderr, "Ratatouille_golden: fail to write the resources to %s\n", o.dir.c_str());
+        return 1;
+    }
+    if (!o.out.empty()) mkdir(o.out.c_str(), 0755);
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_golden: fail to open %s\n", o.csv.c_str());
+            return 1;
+        }
+        fprintf(csv, "case,rate,input,result,exact,max_abs,snr_db\n");
+    }
+
+    printf("Ratatouille_golden: %s %s, max abs %g, snr %.1f dB\n",
+        o.record ? "record to" : "compare with", o.dir.c_str(), o.maxAbs, o.snr);
+    if (!o.record)
+        printf("  %-8s %6s %-8s %-8s %6s %12s %10s\n", "case", "rate", "input", "result",
+            "exact", "max abs", "snr (dB)");
+
+    size_t failed = 0;
+    size_t count = 0;
+    for (auto& c : bench::goldenCases) {
+        if (!o.filter.empty() && std::string(c.name).find(o.filter) == std::string::npos) continue;
+        for (auto rate : bench::goldenRates) {
+            for (auto input : bench::goldenInputs) {
+                const std::string name = bench::renderName(c, rate, input);
+                std::vector<float> cur;
+                count++;
+                if (!bench::render(o, c, rate, input, &cur)) {
+                    printf("  %-8s %6u %-8s %-8s\n", c.name, rate, input, "ERROR");
+                    if (csv) fprintf(csv, "%s,%u,%s,error,,,\n", c.name, rate, input);
+                    failed++;
+                    continue;
+                }
+                if (!o.out.empty()) bench::writeWav(o.out + "/" + name, cur.data(), cur.size(), rate);
+                if (o.record) {
+                    if (!bench::writeWav(o.dir + "/" + name, cur.data(), cur.size(), rate)) failed++;
+                    else printf("  %s\n", name.c_str());
+                    continue;
+                }
+                std::vector<float> ref;
+                const char* result;
+                bench::GoldenDiff d;
+                if (!bench::readWav(o.dir + "/" + name, &ref)) {
+                    result = "MISSING";
+                    failed++;
+                } else {
+                    d = bench::compare(ref, cur);
+                    const bool pass = d.maxAbs <= o.maxAbs && d.snr >= o.snr;
+                    result = pass ? "pass" : "FAIL";
+                    if (!pass) failed++;
+                }
+                printf("  %-8s %6u %-8s %-8s %6s %12.3g %10.1f\n", c.name, rate, input, result,
+                    d.exact ? "yes" : "no", d.maxAbs, d.snr);
+                if (csv) fprintf(csv, "%s,%u,%s,%s,%d,%g,%.2f\n", c.name, rate, input,
+                    result, d.exact, d.maxAbs, d.snr);
+            }
+        }
+    }
+    if (csv) fclose(csv);
+    if (o.record) {
+        printf("Ratatouille_golden: %zu of %zu references written\n", count - failed, count);
+    } else {
+        printf("Ratatouille_golden: %zu of %zu renders %s\n", failed ? failed : count, count,
+            failed ? "FAILED" : "passed");
+    }
+    return failed ? 1 : 0;
+}
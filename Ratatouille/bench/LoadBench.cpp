@@ -0,0 +1,295 @@
+/*
+ * LoadBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_loadbench - measure the time from a load request
+ *                          to the UI notification
+ *
+ *  The plugin is loaded with BenchHost, then every resource is loaded
+ *  repeatedly by a patch:Set message (model A, model B, IR A, IR B),
+ *  and a session restore with all four files is done by the LV2 state
+ *  interface. For each load silent blocks are run in real-time until
+ *  the plugin echo the file on the NOTIFY port.
+ *
+ *  Reported is (mean/max in ms):
+ *      total       host send -> notification seen by the host
+ *      queue       trigger in run() -> worker start
+ *      work        worker start -> worker done
+ *      notify      worker done -> notification written in run()
+ *  and the time the worker spend in each phase, read by the
+ *  XLV2__PROFILE extension (see RatatouilleProfile.h):
+ *      sync        wait for the audio thread to release the slot
+ *      read        file read (NAM models are read and parsed in one
+ *                  go by nam::get_dsp(), so it count as parse)
+ *      parse       json parse and network setup
+ *      resample    resampler setup, IR resampling
+ *      warmup      model warm up run
+ *      partition   FFT partitioning of the IR
+ *      other       work time not covered by a phase
+ *  and the memory held by each model slot and convolver after the
+ *  loads, as the plugin reply to a patch:Get. The resampler filter
+ *  tables are shared in the process, they are shown once as "shared"
+ *  and not counted in the total.
+ *
+ *  When no files are given, a NAM standard WaveNet and a LSTM model
+ *  from ModelZoo, and two decaying noise IRs of 1 second at 44.1kHz
+ *  are written to a temporary directory.
+ *
+ *  usage:
+ *      Ratatouille_loadbench [options]
+ *        -p --plugin  path     plugin binary (default ./Ratatouille.so)
+ *        -r --rate    Hz       sample rate (default 48000)
+ *        -b --block   frames   block size (default 128)
+ *        -n --loads   count    measured loads per resource (default 10)
+ *        -w --warmup  count    loads per resource before measurement (default 1)
+ *        -m --model-a path     model for slot A
+ *        -M --model-b path     model for slot B
+ *        -i --ir-a    path     IR file for the first convolver
+ *        -I --ir-b    path     IR file for the second convolver
+ *        -o --csv     path     write the result as CSV to path
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include "BenchHost.h"
+#include "BenchUtil.h"
+#include "ModelZoo.h"
+
+namespace bench {
+
+struct LoadOptions {
+    std::string plugin = "./Ratatouille.so";
+    uint32_t    rate = 48000;
+    uint32_t    block = 128;
+    uint32_t    loads = 10;
+    uint32_t    warmup = 1;
+    std::string modelA;
+    std::string modelB;
+    std::string irA;
+    std::string irB;
+    std::string csv;
+};
+
+// the stages and phases of one resource, in nanoseconds
+struct LoadStats {
+    enum { TOTAL, QUEUE, WORK, NOTIFY, OTHER, STAGE_COUNT };
+    BlockStats stage[STAGE_COUNT];
+    BlockStats phase[ratatouille::PHASE_COUNT];
+};
+
+static const char* const stageNames[LoadStats::STAGE_COUNT] = {
+    "total", "queue", "work", "notify", "other"
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p --plugin  path     plugin binary (default ./Ratatouille.so)\n"
+        "  -r --rate    Hz       sample rate (default 48000)\n"
+        "  -b --block   frames   block size (default 128)\n"
+        "  -n --loads   count    measured loads per resource (default 10)\n"
+        "  -w --warmup  count    loads per resource before measurement (default 1)\n"
+        "  -m --model-a path     model for slot A\n"
+        "  -M --model-b path     model for slot B\n"
+        "  -i --ir-a    path     IR file for the first convolver\n"
+        "  -I --ir-b    path     IR file for the second convolver\n"
+        "  -o --csv     path     write the result as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, LoadOptions* o) {
+    static const struct option longOptions[] = {
+        {"plugin",  required_argument, 0, 'p'},
+        {"rate",    required_argument, 0, 'r'},
+        {"block",   required_argument, 0, 'b'},
+        {"loads",   required_argument, 0, 'n'},
+        {"warmup",  required_argument, 0, 'w'},
+        {"model-a", required_argument, 0, 'm'},
+        {"model-b", required_argument, 0, 'M'},
+        {"ir-a",    required_argument, 0, 'i'},
+        {"ir-b",    required_argument, 0, 'I'},
+        {"csv",     required_argument, 0, 'o'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:r:b:n:w:m:M:i:I:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'p': o->plugin = optarg; break;
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'b': o->block = strtoul(optarg, nullptr, 10); break;
+            case 'n': o->loads = strtoul(optarg, nullptr, 10); break;
+            case 'w': o->warmup = strtoul(optarg, nullptr, 10); break;
+            case 'm': o->modelA = optarg; break;
+            case 'M': o->modelB = optarg; break;
+            case 'i': o->irA = optarg; break;
+            case 'I': o->irB = optarg; break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return o->rate && o->block && o->loads;
+}
+
+// do one load and add the result to stats, a null property means restore
+static bool loadOnce(BenchHost& host, const LoadOptions& o, const char* property,
+                     const std::string& file, LoadStats* stats) {
+    const ratatouille::Profile* profile = host.profile();
+    const uint32_t serial = profile->load.serial.load(std::memory_order_acquire);
+    const int64_t t0 = ratatouille::profileNow();
+    bool ok;
+    if (property) {
+        ok = host.loadFile(host.map(property), file.c_str());
+    } else {
+        ok = host.restore(o.modelA.c_str(), o.modelB.c_str(), o.irA.c_str(), o.irB.c_str());
+    }
+    const int64_t t1 = ratatouille::profileNow();
+    if (!ok) return false;
+    // the notification is written in the last run() call,
+    // so the worker is idle and the profile is stable here
+    const ratatouille::LoadProfile& p = profile->load;
+    if (p.serial.load(std::memory_order_acquire) == serial) {
+        fprintf(stderr, "Ratatouille_loadbench: no profile update for %s\n",
+            property ? file.c_str() : "restore");
+        return false;
+    }
+    if (!stats) return true;
+    int64_t phases = 0;
+    for (int i = 0; i < ratatouille::PHASE_COUNT; i++) {
+        stats->phase[i].add(p.phaseNs[i]);
+        phases += p.phaseNs[i];
+    }
+    stats->stage[LoadStats::TOTAL].add(t1 - t0);
+    stats->stage[LoadStats::QUEUE].add(p.startNs - p.requestNs);
+    stats->stage[LoadStats::WORK].add(p.doneNs - p.startNs);
+    stats->stage[LoadStats::NOTIFY].add(p.notifyNs - p.doneNs);
+    stats->stage[LoadStats::OTHER].add(std::max<int64_t>(0, p.doneNs - p.startNs - phases));
+    return true;
+}
+
+static void report(const char* name, LoadStats& s, const LoadOptions& o, FILE* csv) {
+    printf("  %s (%zu loads)\n", name, s.stage[LoadStats::TOTAL].count());
+    printf("    %-10s %10s %10s\n", "", "mean (ms)", "max (ms)");
+    for (int i = 0; i < LoadStats::STAGE_COUNT; i++) {
+        if (i == LoadStats::OTHER) {
+            for (int j = 0; j < ratatouille::PHASE_COUNT; j++) {
+                printf("    %-10s %10.3f %10.3f\n", ratatouille::LoadPhaseNames[j],
+                    s.phase[j].mean() * 1e-6, s.phase[j].max() * 1e-6);
+            }
+        }
+        printf("    %-10s %10.3f %10.3f\n", stageNames[i],
+            s.stage[i].mean() * 1e-6, s.stage[i].max() * 1e-6);
+    }
+    if (!csv) return;
+    fprintf(csv, "%s,%u,%u,%zu", name, o.rate, o.block, s.stage[LoadStats::TOTAL].count());
+    for (int i = 0; i < LoadStats::STAGE_COUNT; i++)
+        fprintf(csv, ",%.3f,%.3f", s.stage[i].mean() * 1e-6, s.stage[i].max() * 1e-6);
+    for (int j = 0; j < ratatouille::PHASE_COUNT; j++)
+        fprintf(csv, ",%.3f,%.3f", s.phase[j].mean() * 1e-6, s.phase[j].max() * 1e-6);
+    fprintf(csv, "\n");
+    fflush(csv);
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::LoadOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    // write default resources when no files are given
+    char tmp[] = "/tmp/Ratatouille_loadbench.XXXXXX";
+    std::vector<std::string> generated;
+    if (o.modelA.empty() || o.modelB.empty() || o.irA.empty() || o.irB.empty()) {
+        if (!mkdtemp(tmp)) {
+            fprintf(stderr, "Ratatouille_loadbench: fail to create temporary directory\n");
+            return 1;
+        }
+        bench::ModelZoo zoo;
+        if (!zoo.write(tmp, 48000)) return 1;
+        for (auto& m : zoo.models()) {
+            generated.push_back(m.file);
+            if (o.modelA.empty() && m.name == "wavenet-standard") o.modelA = m.file;
+            if (o.modelB.empty() && m.name == "lstm-16") o.modelB = m.file;
+        }
+        const std::string dir(tmp);
+        if (o.irA.empty()) {
+            o.irA = dir + "/ir-a.wav";
+            generated.push_back(o.irA);
+            if (!bench::writeIR(o.irA, 44100, 44100)) return 1;
+        }
+        if (o.irB.empty()) {
+            o.irB = dir + "/ir-b.wav";
+            generated.push_back(o.irB);
+            if (!bench::writeIR(o.irB, 44100, 44100)) return 1;
+        }
+    }
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_loadbench: fail to open %s\n", o.csv.c_str());
+            return 1;
+        }
+        fprintf(csv, "resource,rate,block,loads");
+        for (int i = 0; i < bench::LoadStats::STAGE_COUNT; i++)
+            fprintf(csv, ",%s_mean_ms,%s_max_ms", bench::stageNames[i], bench::stageNames[i]);
+        for (int j = 0; j < ratatouille::PHASE_COUNT; j++)
+            fprintf(csv, ",%s_mean_ms,%s_max_ms", ratatouille::LoadPhaseNames[j],
+                ratatouille::LoadPhaseNames[j]);
+        fprintf(csv, "\n");
+    }
+
+    int ret = 0;
+    bench::BenchHost host;
+    if (!host.load(o.plugin.c_str(), o.rate, o.block)) {
+        ret = 1;
+    } else if (!host.profile()) {
+        fprintf(stderr, "Ratatouille_loadbench: %s don't provide %s\n",
+            o.plugin.c_str(), XLV2__PROFILE);
+        ret = 1;
+    } else {
+        const struct { const char* name; const char* property; const std::string& file; } jobs[] = {
+            { "model-a", XLV2__MODELFILE,  o.modelA },
+            { "model-b", XLV2__MODELFILE1, o.modelB },
+            { "ir-a",    XLV2__IRFILE,     o.irA },
+            { "ir-b",    XLV2__IRFILE1,    o.irB },
+            { "restore", nullptr,          o.modelA }
+        };
+        printf("Ratatouille_loadbench: %u Hz, %u frames\n", o.rate, o.block);
+        for (auto& job : jobs) {
+            bench::LoadStats stats;
+            bool ok = true;
+            for (uint32_t i = 0; ok && i < o.warmup + o.loads; i++)
+                ok = bench::loadOnce(host, o, job.property, job.file,
+                                     i < o.warmup ? nullptr : &stats);
+            if (!ok) {
+                fprintf(stderr, "Ratatouille_loadbench: load %s fail\n", job.name);
+                ret = 1;
+                continue;
+            }
+            bench::report(job.name, stats, o, csv);
+        }
+        bench::MemoryBytes m;
+        if (host.queryMemory(&m)) {
+            printf("  memory\n");
+            for (int i = 0; i < ratatouille::MEMORY_COUNT; i++)
+                printf("    %-10s %10.2f MiB\n", ratatouille::MemoryPartNames[i],
+                    m.bytes[i] / 1048576.0);
+            printf("    %-10s %10.2f MiB\n", "total", m.total / 1048576.0);
+        }
+    }
+    host.unload();
+    if (csv) fclose(csv);
+    for (auto& f : generated) unlink(f.c_str());
+    if (!generated.empty()) rmdir(tmp);
+    return ret;
+}
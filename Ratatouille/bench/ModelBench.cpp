@@ -0,0 +1,208 @@
+/*
+ * ModelBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_modelbench - time NeuralModel and RtNeuralModel
+ *                           inference for a zoo of synthetic models
+ *
+ *  The models are written by ModelZoo with a sample rate of 48kHz,
+ *  loaded by ModelerSelector like in the plugin, and every model is
+ *  run by compute() at three host rates:
+ *      48000   native, no resampling
+ *      44100   model rate > host rate (needResample == 1)
+ *      96000   model rate < host rate (needResample == 2)
+ *  Reported is the time per compute() call (mean/p99/max) and the
+ *  load relative to the real-time budget for one and for two slots.
+ *
+ *  usage:
+ *      Ratatouille_modelbench [options]
+ *        -b --block   frames   block size (default 128)
+ *        -t --seconds sec      audio processed per model and rate (default 2)
+ *        -r --rates   list     host rates (default 48000,44100,96000)
+ *        -m --match   text     only run models which name contain text
+ *        -d --dir     path     write the zoo to path and keep it
+ *        -o --csv     path     write the result as CSV to path
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "ModelerSelector.h"
+
+#include "BenchUtil.h"
+#include "ModelZoo.h"
+
+namespace bench {
+
+struct ModelOptions {
+    uint32_t    block = 128;
+    double      seconds = 2.0;
+    std::vector<uint32_t> rates = {48000, 44100, 96000};
+    std::string match;
+    std::string dir;
+    std::string csv;
+};
+
+static const uint32_t zooRate = 48000;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -b --block   frames   block size (default 128)\n"
+        "  -t --seconds sec      audio processed per model and rate (default 2)\n"
+        "  -r --rates   list     host rates (default 48000,44100,96000)\n"
+        "  -m --match   text     only run models which name contain text\n"
+        "  -d --dir     path     write the zoo to path and keep it\n"
+        "  -o --csv     path     write the result as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, ModelOptions* o) {
+    static const struct option longOptions[] = {
+        {"block",   required_argument, 0, 'b'},
+        {"seconds", required_argument, 0, 't'},
+        {"rates",   required_argument, 0, 'r'},
+        {"match",   required_argument, 0, 'm'},
+        {"dir",     required_argument, 0, 'd'},
+        {"csv",     required_argument, 0, 'o'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "b:t:r:m:d:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'b': o->block = strtoul(optarg, nullptr, 10); break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'r': if (!parseList(optarg, &o->rates)) return false; break;
+            case 'm': o->match = optarg; break;
+            case 'd': o->dir = optarg; break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return o->block && o->seconds > 0.0;
+}
+
+// loadModel() wait for the Sync signal from the audio thread,
+// so run it in a extra thread and play the audio thread here
+static bool loadModel(ratatouille::ModelerSelector& slot, std::condition_variable& Sync) {
+    std::atomic<bool> done(false);
+    bool ret = false;
+    std::thread loader([&]() {
+        ret = slot.loadModel();
+        done.store(true, std::memory_order_release);
+    });
+    while (!done.load(std::memory_order_acquire)) {
+        Sync.notify_all();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    loader.join();
+    return ret;
+}
+
+static bool measure(const ModelZoo::Model& m, uint32_t rate, const ModelOptions& o,
+                    BlockStats* stats) {
+    std::condition_variable Sync;
+    ratatouille::ModelerSelector slot(&Sync);
+    slot.init(rate);
+    slot.setModelFile(m.file);
+    if (!loadModel(slot, Sync)) {
+        fprintf(stderr, "Ratatouille_modelbench: fail to load %s\n", m.file.c_str());
+        return false;
+    }
+    std::vector<float> in(o.block);
+    std::vector<float> out(o.block);
+    SignalSource source;
+    source.setup("noise", rate);
+    const uint32_t blocks = std::max<uint32_t>(50, static_cast<uint32_t>(o.seconds * rate / o.block));
+    const uint32_t warmup = std::max<uint32_t>(10, blocks / 20);
+    stats->clear();
+    stats->reserve(blocks);
+    for (uint32_t i = 0; i < warmup + blocks; i++) {
+        source.fill(in.data(), o.block);
+        const auto t0 = std::chrono::steady_clock::now();
+        slot.compute(o.block, in.data(), out.data());
+        const auto t1 = std::chrono::steady_clock::now();
+        if (i >= warmup)
+            stats->add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    return true;
+}
+
+static void removeZoo(const ModelZoo& zoo, const char* dir) {
+    for (auto& m : zoo.models()) unlink(m.file.c_str());
+    rmdir(dir);
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::ModelOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    char tmp[] = "/tmp/Ratatouille_modelbench.XXXXXX";
+    const bool keep = !o.dir.empty();
+    if (!keep) {
+        if (!mkdtemp(tmp)) {
+            fprintf(stderr, "Ratatouille_modelbench: fail to create temporary directory\n");
+            return 1;
+        }
+        o.dir = tmp;
+    }
+    bench::ModelZoo zoo;
+    if (!zoo.write(o.dir, bench::zooRate)) {
+        if (!keep) bench::removeZoo(zoo, tmp);
+        return 1;
+    }
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_modelbench: fail to open %s\n", o.csv.c_str());
+            if (!keep) bench::removeZoo(zoo, tmp);
+            return 1;
+        }
+        fprintf(csv, "model,weights,model_rate,host_rate,block,mean_us,p99_us,max_us,"
+                     "budget_us,load,two_slots\n");
+    }
+
+    printf("Ratatouille_modelbench: %u frames, models at %u Hz\n", o.block, bench::zooRate);
+    printf("  %-18s %8s %6s %10s %10s %10s %9s %9s\n", "model", "weights", "host",
+        "mean (us)", "p99 (us)", "max (us)", "load", "2 slots");
+    int ret = 0;
+    bench::BlockStats stats;
+    for (auto& m : zoo.models()) {
+        if (!o.match.empty() && m.name.find(o.match) == std::string::npos) continue;
+        for (auto rate : o.rates) {
+            if (!bench::measure(m, rate, o, &stats)) {
+                ret = 1;
+                continue;
+            }
+            const double budget = bench::blockBudget(o.block, rate) * 0.001;
+            const double mean = stats.mean() * 0.001;
+            const double p99 = stats.percentile(0.99) * 0.001;
+            const double max = stats.max() * 0.001;
+            printf("  %-18s %8zu %6u %10.2f %10.2f %10.2f %8.2f%% %8.2f%%\n", m.name.c_str(),
+                m.weights, rate, mean, p99, max, 100.0 * p99 / budget, 200.0 * p99 / budget);
+            if (csv) {
+                fprintf(csv, "%s,%zu,%u,%u,%u,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f\n", m.name.c_str(),
+                    m.weights, bench::zooRate, rate, o.block, mean, p99, max, budget,
+                    p99 / budget, 2.0 * p99 / budget);
+                fflush(csv);
+            }
+        }
+    }
+    if (csv) fclose(csv);
+    if (!keep) bench::removeZoo(zoo, tmp);
+    return ret;
+}
@@ -0,0 +1,228 @@
+/*
+ * ModelZoo.h
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** ModelZoo - write synthetic models for the Ratatouille benchmarks
+ *
+ *  The models got deterministic random weights, they sound like
+ *  nothing, but cost the same as a trained model of the same
+ *  architecture, so no downloads are needed to run the benchmarks.
+ *
+ *  WaveNet (*.nam)     - standard, lite, feather and nano
+ *                        in the NAM 0.5 file format
+ *  LSTM/GRU (*.json)   - one recurrent layer plus a dense output layer
+ *                        in the RTNeural (keras) json format
+ *  dense (*.json)      - dense only models
+ *
+ *  usage:
+ *      bench::ModelZoo zoo;
+ *      // write all models with the given sample rate to dir
+ *      zoo.write(dir, 48000);
+ *      for (auto& m : zoo.models()) m.name, m.file ...
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#pragma once
+
+#ifndef MODEL_ZOO_H_
+#define MODEL_ZOO_H_
+
+namespace bench {
+
+class ModelZoo
+{
+public:
+    struct Model {
+        std::string name;
+        std::string file;
+        size_t      weights;
+    };
+
+    ModelZoo() : seed(0x2545F491u) {}
+
+    bool write(const std::string& dir, uint32_t sampleRate) {
+        list.clear();
+        const std::vector<int> full = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512};
+        const std::vector<int> lite1 = {1, 2, 4, 8, 16, 32, 64};
+        const std::vector<int> lite2 = {128, 256, 512, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512};
+        bool ret = true;
+        ret &= writeWaveNet(dir, "wavenet-standard", sampleRate, 16, 8, full, full);
+        ret &= writeWaveNet(dir, "wavenet-lite", sampleRate, 12, 6, lite1, lite2);
+        ret &= writeWaveNet(dir, "wavenet-feather", sampleRate, 8, 4, lite1, lite2);
+        ret &= writeWaveNet(dir, "wavenet-nano", sampleRate, 4, 2, lite1, lite2);
+        const int hidden[] = {8, 16, 24, 32, 40};
+        for (auto h : hidden) ret &= writeRecurrent(dir, "lstm", h, sampleRate);
+        for (auto h : hidden) ret &= writeRecurrent(dir, "gru", h, sampleRate);
+        ret &= writeDense(dir, 16, sampleRate);
+        ret &= writeDense(dir, 32, sampleRate);
+        return ret;
+    }
+
+    const std::vector<Model>& models() const { return list; }
+
+private:
+    std::vector<Model> list;
+    uint32_t           seed;
+    size_t             count;
+
+    // uniform in [-scale, scale]
+    float next(float scale) {
+        seed = seed * 1664525u + 1013904223u;
+        return scale * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+    }
+
+    void weights(FILE* f, size_t n, float scale, bool& first) {
+        for (size_t i = 0; i < n; i++) {
+            fprintf(f, first ? "%.6f" : ",%.6f", next(scale));
+            first = false;
+        }
+        count += n;
+    }
+
+    void dilations(FILE* f, const std::vector<int>& d) {
+        for (size_t i = 0; i < d.size(); i++) fprintf(f, i ? ",%i" : "%i", d[i]);
+    }
+
+    // weights of one NAM layer array in the order of
+    // nam::wavenet::_LayerArray::set_weights_()
+    void layerArray(FILE* f, int inputSize, int channels, int headSize, int kernel,
+                    size_t layers, bool headBias, bool& first) {
+        const float scale = 0.5f / std::sqrt(static_cast<float>(channels * kernel));
+        weights(f, channels * inputSize, scale, first);                 // _rechannel
+        for (size_t i = 0; i < layers; i++) {
+            weights(f, kernel * channels * channels + channels, scale, first); // _conv
+            weights(f, channels, scale, first);                         // _input_mixin
+            weights(f, channels * channels + channels, scale, first);   // _1x1
+        }
+        weights(f, headSize * channels + (headBias ? headSize : 0), scale, first); // _head_rechannel
+    }
+
+    bool writeWaveNet(const std::string& dir, const char* name, uint32_t sampleRate,
+                      int channels1, int channels2,
+                      const std::vector<int>& dil1, const std::vector<int>& dil2) {
+        const std::string file = dir + "/" + name + ".nam";
+        FILE* f = fopen(file.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "Unable to write %s\n", file.c_str());
+            return false;
+        }
+        fprintf(f, "{\"version\": \"0.5.4\", \"architecture\": \"WaveNet\", \"config\": {\"layers\": [");
+        fprintf(f, "{\"input_size\": 1, \"condition_size\": 1, \"head_size\": %i, \"channels\": %i, "
+                   "\"kernel_size\": 3, \"dilations\": [", channels2, channels1);
+        dilations(f, dil1);
+        fprintf(f, "], \"activation\": \"Tanh\", \"gated\": false, \"head_bias\": false}, ");
+        fprintf(f, "{\"input_size\": %i, \"condition_size\": 1, \"head_size\": 1, \"channels\": %i, "
+                   "\"kernel_size\": 3, \"dilations\": [", channels1, channels2);
+        dilations(f, dil2);
+        fprintf(f, "], \"activation\": \"Tanh\", \"gated\": false, \"head_bias\": true}], "
+                   "\"head\": null, \"head_scale\": 0.02}, \"weights\": [");
+        count = 0;
+        bool first = true;
+        layerArray(f, 1, channels1, channels2, 3, dil1.size(), false, first);
+        layerArray(f, channels1, channels2, 1, 3, dil2.size(), true, first);
+        fprintf(f, ",0.02");  // head_scale
+        count++;
+        fprintf(f, "], \"sample_rate\": %u}\n", sampleRate);
+        fclose(f);
+        list.push_back({name, file, count});
+        return true;
+    }
+
+    // a 2D keras weight matrix rows x cols
+    void matrix(FILE* f, int rows, int cols, float scale) {
+        fprintf(f, "[");
+        for (int r = 0; r < rows; r++) {
+            bool first = true;
+            fprintf(f, r ? ",[" : "[");
+            weights(f, cols, scale, first);
+            fprintf(f, "]");
+        }
+        fprintf(f, "]");
+    }
+
+    void vector(FILE* f, int n, float scale) {
+        bool first = true;
+        fprintf(f, "[");
+        weights(f, n, scale, first);
+        fprintf(f, "]");
+    }
+
+    // RTNeural::json_parser reads the sample rate from a
+    // "samplerate": line, see RtNeuralModel::get_samplerate()
+    void header(FILE* f, uint32_t sampleRate) {
+        fprintf(f, "{\n\"samplerate\": %u,\n\"in_shape\": [null, null, 1],\n\"layers\": [\n", sampleRate);
+    }
+
+    bool writeRecurrent(const std::string& dir, const char* type, int hidden, uint32_t sampleRate) {
+        const std::string name = std::string(type) + "-" + std::to_string(hidden);
+        const std::string file = dir + "/" + name + ".json";
+        FILE* f = fopen(file.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "Unable to write %s\n", file.c_str());
+            return false;
+        }
+        const bool lstm = !strcmp(type, "lstm");
+        const int gates = (lstm ? 4 : 3) * hidden;
+        const float scale = 0.5f / std::sqrt(static_cast<float>(hidden));
+        count = 0;
+        header(f, sampleRate);
+        fprintf(f, "{\"type\": \"%s\", \"activation\": \"\", \"shape\": [null, null, %i], \"weights\": [",
+            type, hidden);
+        matrix(f, 1, gates, scale);
+        fprintf(f, ",");
+        matrix(f, hidden, gates, scale);
+        fprintf(f, ",");
+        if (lstm) vector(f, gates, scale);
+        else matrix(f, 2, gates, scale);
+        fprintf(f, "]},\n{\"type\": \"dense\", \"activation\": \"\", \"shape\": [null, null, 1], \"weights\": [");
+        matrix(f, hidden, 1, scale);
+        fprintf(f, ",");
+        vector(f, 1, scale);
+        fprintf(f, "]}\n]\n}\n");
+        fclose(f);
+        list.push_back({name, file, count});
+        return true;
+    }
+
+    bool writeDense(const std::string& dir, int width, uint32_t sampleRate) {
+        const std::string name = "dense-" + std::to_string(width);
+        const std::string file = dir + "/" + name + ".json";
+        FILE* f = fopen(file.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "Unable to write %s\n", file.c_str());
+            return false;
+        }
+        const float scale = 0.5f / std::sqrt(static_cast<float>(width));
+        count = 0;
+        header(f, sampleRate);
+        const int in[3] = {1, width, width};
+        const int out[3] = {width, width, 1};
+        for (int l = 0; l < 3; l++) {
+            fprintf(f, "%s{\"type\": \"dense\", \"activation\": \"%s\", \"shape\": [null, null, %i], \"weights\": [",
+                l ? ",\n" : "", l < 2 ? "tanh" : "", out[l]);
+            matrix(f, in[l], out[l], scale);
+            fprintf(f, ",");
+            vector(f, out[l], scale);
+            fprintf(f, "]}");
+        }
+        fprintf(f, "\n]\n}\n");
+        fclose(f);
+        list.push_back({name, file, count});
+        return true;
+    }
+};
+
+} // end namespace bench
+
+#endif // MODEL_ZOO_H_
@@ -0,0 +1,321 @@
+/*
+ * RatatouilleBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_bench - measure the processing cost of Ratatouille.so
+ *                      without a DAW
+ *
+ *  The plugin is loaded with BenchHost, the given models and IR files
+ *  are loaded by patch:Set messages, and then blocks of a test signal
+ *  are pushed through run(). Reported is the time per run() call as
+ *  p50/p99/p99.9/max, and the fraction of the real-time budget
+ *  (block size / sample rate) that it takes, and the time spend in
+ *  each stage of run_dsp_() as the plugin report it on the NOTIFY port,
+ *  and the smoothed DSP load the plugin report on its output port.
+ *
+ *  In sweep mode every combination of sample rate, block size, number
+ *  of loaded models (0, 1, 2) and number of loaded IRs (0, 1, 2) is
+ *  measured on a fresh instance, and one CSV row is written for each.
+ *  The second slot/IR reuse the first file when no second file is given.
+ *
+ *  usage:
+ *      Ratatouille_bench [options]
+ *        -p --plugin  path     plugin binary (default ./Ratatouille.so)
+ *        -r --rate    Hz       sample rate (default 48000)
+ *        -b --block   frames   block size (default 128)
+ *        -n --blocks  count    measured blocks (default 20000)
+ *        -w --warmup  count    blocks run before measurement (default 500)
+ *        -s --signal  name     silence, noise, sine or impulse (default noise)
+ *        -f --file    path     use the first channel of a audio file as input
+ *        -m --model-a path     model for slot A
+ *        -M --model-b path     model for slot B
+ *        -i --ir-a    path     IR file for the first convolver
+ *        -I --ir-b    path     IR file for the second convolver
+ *        -F --fifo             run the benchmark thread with SCHED_FIFO
+ *        -P --pipeline         enable the pipeline mode (one block latency)
+ *        -S --sweep            measure all rate/block/model/IR combinations
+ *        -o --csv     path     write the sweep result to path (default Ratatouille_sweep.csv)
+ *        -t --seconds sec      audio measured per combination (default 10)
+ *           --rates   list     sweep sample rates (default 44100,48000,96000,192000)
+ *           --sizes   list     sweep block sizes (default 32,64,...,4096)
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "BenchHost.h"
+#include "BenchUtil.h"
+
+namespace bench {
+
+struct Options {
+    std::string plugin = "./Ratatouille.so";
+    uint32_t    rate = 48000;
+    uint32_t    block = 128;
+    uint32_t    blocks = 20000;
+    uint32_t    warmup = 500;
+    std::string signal = "noise";
+    std::string file;
+    std::string modelA;
+    std::string modelB;
+    std::string irA;
+    std::string irB;
+    bool        fifo = false;
+    bool        pipeline = false;
+    bool        sweep = false;
+    std::string csv = "Ratatouille_sweep.csv";
+    double      seconds = 10.0;
+    std::vector<uint32_t> rates = {44100, 48000, 96000, 192000};
+    std::vector<uint32_t> sizes = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p --plugin  path     plugin binary (default ./Ratatouille.so)\n"
+        "  -r --rate    Hz       sample rate (default 48000)\n"
+        "  -b --block   frames   block size (default 128)\n"
+        "  -n --blocks  count    measured blocks (default 20000)\n"
+        "  -w --warmup  count    blocks run before measurement (default 500)\n"
+        "  -s --signal  name     silence, noise, sine or impulse (default noise)\n"
+        "  -f --file    path     use the first channel of a audio file as input\n"
+        "  -m --model-a path     model for slot A\n"
+        "  -M --model-b path     model for slot B\n"
+        "  -i --ir-a    path     IR file for the first convolver\n"
+        "  -I --ir-b    path     IR file for the second convolver\n"
+        "  -F --fifo             run the benchmark thread with SCHED_FIFO\n"
+        "  -P --pipeline         enable the pipeline mode (one block latency)\n"
+        "  -S --sweep            measure all rate/block/model/IR combinations\n"
+        "  -o --csv     path     write the sweep result to path (default Ratatouille_sweep.csv)\n"
+        "  -t --seconds sec      audio measured per combination (default 10)\n"
+        "     --rates   list     sweep sample rates (default 44100,48000,96000,192000)\n"
+        "     --sizes   list     sweep block sizes (default 32,64,...,4096)\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, Options* o) {
+    static const struct option longOptions[] = {
+        {"plugin",  required_argument, 0, 'p'},
+        {"rate",    required_argument, 0, 'r'},
+        {"block",   required_argument, 0, 'b'},
+        {"blocks",  required_argument, 0, 'n'},
+        {"warmup",  required_argument, 0, 'w'},
+        {"signal",  required_argument, 0, 's'},
+        {"file",    required_argument, 0, 'f'},
+        {"model-a", required_argument, 0, 'm'},
+        {"model-b", required_argument, 0, 'M'},
+        {"ir-a",    required_argument, 0, 'i'},
+        {"ir-b",    required_argument, 0, 'I'},
+        {"fifo",    no_argument,       0, 'F'},
+        {"pipeline", no_argument,      0, 'P'},
+        {"sweep",   no_argument,       0, 'S'},
+        {"csv",     required_argument, 0, 'o'},
+        {"seconds", required_argument, 0, 't'},
+        {"rates",   required_argument, 0, 'R'},
+        {"sizes",   required_argument, 0, 'B'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:r:b:n:w:s:f:m:M:i:I:FPSo:t:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'p': o->plugin = optarg; break;
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'b': o->block = strtoul(optarg, nullptr, 10); break;
+            case 'n': o->blocks = strtoul(optarg, nullptr, 10); break;
+            case 'w': o->warmup = strtoul(optarg, nullptr, 10); break;
+            case 's': o->signal = optarg; break;
+            case 'f': o->file = optarg; break;
+            case 'm': o->modelA = optarg; break;
+            case 'M': o->modelB = optarg; break;
+            case 'i': o->irA = optarg; break;
+            case 'I': o->irB = optarg; break;
+            case 'F': o->fifo = true; break;
+            case 'P': o->pipeline = true; break;
+            case 'S': o->sweep = true; break;
+            case 'o': o->csv = optarg; break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'R': if (!parseList(optarg, &o->rates)) return false; break;
+            case 'B': if (!parseList(optarg, &o->sizes)) return false; break;
+            default: return false;
+        }
+    }
+    if (!o->rate || !o->block || !o->blocks || o->seconds <= 0.0) return false;
+    return true;
+}
+
+static void setFifo() {
+    sched_param sch_params;
+    sch_params.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sch_params)) {
+        fprintf(stderr, "Ratatouille_bench: fail to set SCHED_FIFO, continue with default policy\n");
+    }
+}
+
+// load the first nModels models and the first nIrs IR files
+static bool loadResources(BenchHost& host, const Options& o, int nModels = 2, int nIrs = 2) {
+    const struct { const char* uri; const std::string& file; bool use; } res[] = {
+        { XLV2__MODELFILE,  o.modelA, nModels > 0 },
+        { XLV2__MODELFILE1, o.modelB, nModels > 1 },
+        { XLV2__IRFILE,     o.irA,    nIrs > 0 },
+        { XLV2__IRFILE1,    o.irB,    nIrs > 1 }
+    };
+    for (auto& r : res) {
+        if (!r.use || r.file.empty()) continue;
+        if (!host.loadFile(host.map(r.uri), r.file.c_str())) {
+            fprintf(stderr, "Ratatouille_bench: fail to load %s\n", r.file.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// warm up and time blocks run() calls, keep the last stage timings
+// the plugin send on the NOTIFY port
+static void measure(BenchHost& host, SignalSource& source, uint32_t block,
+                    uint32_t warmup, uint32_t blocks, BlockStats* stats,
+                    DspTimes* dsp = nullptr) {
+    for (uint32_t i = 0; i < warmup; i++) {
+        source.fill(host.input(), block);
+        host.run(block);
+    }
+    stats->clear();
+    stats->reserve(blocks);
+    for (uint32_t i = 0; i < blocks; i++) {
+        source.fill(host.input(), block);
+        stats->add(host.runTimed(block));
+        if (dsp) host.findDspProfile(dsp);
+    }
+}
+
+static void report(const Options& o, BlockStats& stats, const DspTimes& dsp, float dspLoad) {
+    const double budget = blockBudget(o.block, o.rate);
+    const double p[4] = {
+        static_cast<double>(stats.percentile(0.5)),
+        static_cast<double>(stats.percentile(0.99)),
+        static_cast<double>(stats.percentile(0.999)),
+        static_cast<double>(stats.max())
+    };
+    printf("Ratatouille_bench: %u Hz, %u frames, %zu blocks, budget %.2f us\n",
+        o.rate, o.block, stats.count(), budget * 0.001);
+    printf("  slot A: %s\n  slot B: %s\n  IR A:   %s\n  IR B:   %s\n",
+        o.modelA.empty() ? "None" : o.modelA.c_str(),
+        o.modelB.empty() ? "None" : o.modelB.c_str(),
+        o.irA.empty() ? "None" : o.irA.c_str(),
+        o.irB.empty() ? "None" : o.irB.c_str());
+    printf("  %-10s %10s %10s %10s %10s\n", "", "p50", "p99", "p99.9", "max");
+    printf("  %-10s %10.2f %10.2f %10.2f %10.2f\n", "time (us)",
+        p[0] * 0.001, p[1] * 0.001, p[2] * 0.001, p[3] * 0.001);
+    printf("  %-10s %9.2f%% %9.2f%% %9.2f%% %9.2f%%\n", "budget",
+        100.0 * p[0] / budget, 100.0 * p[1] / budget, 100.0 * p[2] / budget, 100.0 * p[3] / budget);
+    printf("  %-10s %9.2f%%\n", "dsp load", dspLoad);
+    if (!dsp.blocks) return;
+    printf("  stages of the last %u blocks (us)\n", dsp.blocks);
+    printf("  %-12s %10s %10s %10s\n", "", "min", "mean", "max");
+    for (int i = 0; i < ratatouille::STAGE_COUNT; i++)
+        printf("  %-12s %10.2f %10.2f %10.2f\n", ratatouille::DspStageNames[i],
+            dsp.minUs[i], dsp.meanUs[i], dsp.maxUs[i]);
+}
+
+static int runSingle(const Options& o, SignalSource& source) {
+    BenchHost host;
+    if (!host.load(o.plugin.c_str(), o.rate, o.block)) return 1;
+    if (!loadResources(host, o)) return 1;
+    *host.control(PIPELINE) = o.pipeline ? 1.0f : 0.0f;
+    if (o.fifo) setFifo();
+
+    BlockStats stats;
+    DspTimes dsp;
+    measure(host, source, o.block, o.warmup, o.blocks, &stats, &dsp);
+    report(o, stats, dsp, *host.control(DSP_LOAD));
+    if (o.pipeline) printf("  %-10s %10.0f frames\n", "latency", *host.control(LATENCY));
+    host.unload();
+    return 0;
+}
+
+// the rows are written in a fixed order, so that the files of two
+// releases could be compared with diff
+static int runSweep(const Options& o, SignalSource& source, bool generated) {
+    // the second slot and IR fall back to the first file
+    Options res = o;
+    if (res.modelB.empty()) res.modelB = res.modelA;
+    if (res.irB.empty()) res.irB = res.irA;
+    const int maxModels = res.modelA.empty() ? 0 : 2;
+    const int maxIrs = res.irA.empty() ? 0 : 2;
+
+    // the plugin print to stdout, so the result always goes to a file
+    FILE* csv = fopen(o.csv.c_str(), "w");
+    if (!csv) {
+        fprintf(stderr, "Ratatouille_bench: fail to open %s\n", o.csv.c_str());
+        return 1;
+    }
+    fprintf(csv, "rate,block,models,irs,blocks,budget_us,mean_us,p50_us,p99_us,p999_us,max_us,"
+                 "p50_load,p99_load,max_load,overruns\n");
+    if (o.fifo) setFifo();
+
+    int ret = 0;
+    BlockStats stats;
+    for (auto rate : o.rates) {
+        for (auto block : o.sizes) {
+            const uint32_t blocks = std::max<uint32_t>(100,
+                static_cast<uint32_t>(o.seconds * rate / block));
+            const uint32_t warmup = std::max<uint32_t>(10, rate / block);
+            for (int m = 0; m <= maxModels; m++) {
+                for (int r = 0; r <= maxIrs; r++) {
+                    fprintf(stderr, "Ratatouille_bench: %u Hz %u frames %i models %i IRs\n",
+                        rate, block, m, r);
+                    BenchHost host;
+                    if (!host.load(o.plugin.c_str(), rate, block) ||
+                        !loadResources(host, res, m, r)) {
+                        ret = 1;
+                        continue;
+                    }
+                    *host.control(PIPELINE) = o.pipeline ? 1.0f : 0.0f;
+                    if (generated) source.setup(o.signal, rate);
+                    measure(host, source, block, warmup, blocks, &stats);
+                    host.unload();
+
+                    const double budget = blockBudget(block, rate);
+                    const double p50 = stats.percentile(0.5);
+                    const double p99 = stats.percentile(0.99);
+                    const double p999 = stats.percentile(0.999);
+                    const double max = stats.max();
+                    const size_t overruns = stats.countAbove(budget);
+                    fprintf(csv, "%u,%u,%i,%i,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%zu\n",
+                        rate, block, m, r, blocks, budget * 0.001, stats.mean() * 0.001,
+                        p50 * 0.001, p99 * 0.001, p999 * 0.001, max * 0.001,
+                        p50 / budget, p99 / budget, max / budget, overruns);
+                    fflush(csv);
+                }
+            }
+        }
+    }
+    fclose(csv);
+    return ret;
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::Options o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    bench::SignalSource source;
+    if (!o.file.empty()) {
+        if (!source.open(o.file)) return 1;
+    } else if (!source.setup(o.signal, o.rate)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    if (o.sweep) return bench::runSweep(o, source, o.file.empty());
+    return bench::runSingle(o, source);
+}
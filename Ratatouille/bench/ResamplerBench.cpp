@@ -0,0 +1,292 @@
+/*
+ * ResamplerBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_resampbench - microbenchmarks for the gx_resample
+ *                            classes and the zita Resampler kernel
+ *
+ *  FixedRateResampler  - up() and down() round trip per block,
+ *                        like the model rate conversion in NeuralModel::compute()
+ *  SimpleResampler     - up() and down() round trip per block
+ *                        with a integer factor
+ *  StreamingResampler  - process() per block
+ *  BufferResampler     - process() of a whole buffer, like the IR
+ *                        conversion in the convolver load path
+ *  Resampler           - the zita kernel process() per block, for a
+ *                        range of hlen values. The gx_resample classes
+ *                        use a fixed hlen (16 for Fixed/Simple,
+ *                        32 for Buffer/Streaming).
+ *
+ *  Reported is the time per call (mean/p99/max) and the throughput
+ *  in input samples per second.
+ *
+ *  usage:
+ *      Ratatouille_resampbench [options]
+ *        -b --sizes   list     block sizes (default 64,256,1024)
+ *        -q --hlen    list     hlen values for the zita kernel
+ *                              (default 8,16,24,32,48,64,96)
+ *        -t --seconds sec      input audio per combination (default 1)
+ *        -o --csv     path     write the result as CSV to path
+ */
+
+#include <getopt.h>
+#include <chrono>
+
+#include "gx_resampler.h"
+
+#include "BenchUtil.h"
+
+namespace bench {
+
+struct ResampOptions {
+    std::vector<uint32_t> sizes = {64, 256, 1024};
+    std::vector<uint32_t> hlens = {8, 16, 24, 32, 48, 64, 96};
+    double      seconds = 1.0;
+    std::string csv;
+};
+
+// the conversions we see in the plugin: model rate <-> host rate
+static const struct { uint32_t in; uint32_t out; } ratios[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000, 96000 },
+    { 96000, 48000 },
+    { 44100, 96000 },
+    { 96000, 44100 }
+};
+
+class ResampBench
+{
+public:
+    ResampBench(const ResampOptions& o_) : o(o_), csv(nullptr) {}
+
+    bool open() {
+        if (!o.csv.empty()) {
+            csv = fopen(o.csv.c_str(), "w");
+            if (!csv) {
+                fprintf(stderr, "Ratatouille_resampbench: fail to open %s\n", o.csv.c_str());
+                return false;
+            }
+            fprintf(csv, "class,in_rate,out_rate,hlen,block,calls,mean_us,p99_us,max_us,msamples_per_s\n");
+        }
+        printf("  %-10s %6s %6s %4s %7s %8s %10s %10s %10s %12s\n", "class", "in", "out",
+            "hlen", "block", "calls", "mean (us)", "p99 (us)", "max (us)", "MSamples/s");
+        return true;
+    }
+
+    void close() {
+        if (csv) fclose(csv);
+        csv = nullptr;
+    }
+
+    void fixedRate() {
+        for (auto& r : ratios) {
+            for (auto block : o.sizes) {
+                // r.in is the host rate, r.out the model rate,
+                // used the same way as NeuralModel::compute()
+                gx_resample::FixedRateResampler smp;
+                std::vector<float> in(block);
+                std::vector<float> out(block + 1);
+                if (r.in < r.out) {
+                    if (smp.setup(r.in, r.out)) continue;
+                    std::vector<float> mid(smp.max_out_count(block) + 1);
+                    time("Fixed", r.in, r.out, 16, block, in, [&]() {
+                        smp.up(block, in.data(), mid.data());
+                        smp.down(mid.data(), out.data());
+                    });
+                } else {
+                    if (smp.setup(r.out, r.in)) continue;
+                    const int count = static_cast<int>(
+                        ceil((block * static_cast<double>(r.out)) / r.in));
+                    std::vector<float> mid(count + 1);
+                    time("Fixed", r.in, r.out, 16, block, in, [&]() {
+                        smp.down(in.data(), mid.data());
+                        smp.up(count, mid.data(), out.data());
+                    });
+                }
+            }
+        }
+    }
+
+    void simple() {
+        const uint32_t rates[] = { 44100, 48000 };
+        const uint32_t facts[] = { 2, 4 };
+        for (auto rate : rates) {
+            for (auto fact : facts) {
+                for (auto block : o.sizes) {
+                    gx_resample::SimpleResampler smp;
+                    smp.setup(rate, fact);
+                    std::vector<float> in(block);
+                    std::vector<float> mid(smp.get_max_out_size(block) + 1);
+                    std::vector<float> out(block + 1);
+                    time("Simple", rate, rate * fact, 16, block, in, [&]() {
+                        smp.up(block, in.data(), mid.data());
+                        smp.down(block, mid.data(), out.data());
+                    });
+                }
+            }
+        }
+    }
+
+    void streaming() {
+        for (auto& r : ratios) {
+            for (auto block : o.sizes) {
+                gx_resample::StreamingResampler smp;
+                if (!smp.setup(r.in, r.out, 1)) continue;
+                std::vector<float> in(block);
+                std::vector<float> out(smp.get_max_out_size(block) + 1);
+                time("Streaming", r.in, r.out, 32, block, in, [&]() {
+                    smp.process(block, in.data(), out.data());
+                });
+            }
+        }
+    }
+
+    // one call per second of input audio
+    void buffer() {
+        for (auto& r : ratios) {
+            const uint32_t len = r.in;
+            std::vector<float> in(len);
+            SignalSource source;
+            source.setup("noise", r.in);
+            source.fill(in.data(), len);
+            const uint32_t calls = std::max<uint32_t>(3, static_cast<uint32_t>(o.seconds * 3));
+            BlockStats stats;
+            stats.reserve(calls);
+            for (uint32_t i = 0; i < calls; i++) {
+                gx_resample::BufferResampler smp;
+                int32_t olen = 0;
+                const auto t0 = std::chrono::steady_clock::now();
+                float* out = smp.process(r.in, len, in.data(), r.out, &olen);
+                const auto t1 = std::chrono::steady_clock::now();
+                delete[] out;
+                stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            }
+            report("Buffer", r.in, r.out, 32, len, stats);
+        }
+    }
+
+    void kernel() {
+        for (auto& r : ratios) {
+            for (auto hlen : o.hlens) {
+                for (auto block : o.sizes) {
+                    Resampler smp;
+                    if (smp.setup(r.in, r.out, 1, hlen)) continue;
+                    // pre-fill like StreamingResampler::setup()
+                    smp.inp_count = smp.inpsize() / 2 - 1;
+                    smp.inp_data = 0;
+                    smp.out_count = 1;
+                    smp.out_data = 0;
+                    smp.process();
+                    const uint32_t maxOut = static_cast<uint32_t>(
+                        std::ceil(static_cast<double>(block) * r.out / r.in)) + 1;
+                    std::vector<float> in(block);
+                    std::vector<float> out(maxOut);
+                    time("Resampler", r.in, r.out, hlen, block, in, [&]() {
+                        smp.inp_count = block;
+                        smp.inp_data = in.data();
+                        smp.out_count = maxOut;
+                        smp.out_data = out.data();
+                        smp.process();
+                    });
+                }
+            }
+        }
+    }
+
+private:
+    const ResampOptions& o;
+    FILE* csv;
+
+    // run f() for seconds of input audio, in is refilled with noise per call
+    template <class F>
+    void time(const char* name, uint32_t inRate, uint32_t outRate, uint32_t hlen,
+              uint32_t block, std::vector<float>& in, F f) {
+        SignalSource source;
+        source.setup("noise", inRate);
+        const uint32_t calls = std::max<uint32_t>(100, static_cast<uint32_t>(o.seconds * inRate / block));
+        const uint32_t warmup = std::max<uint32_t>(10, calls / 20);
+        BlockStats stats;
+        stats.reserve(calls);
+        for (uint32_t i = 0; i < warmup + calls; i++) {
+            source.fill(in.data(), block);
+            const auto t0 = std::chrono::steady_clock::now();
+            f();
+            const auto t1 = std::chrono::steady_clock::now();
+            if (i >= warmup)
+                stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+        report(name, inRate, outRate, hlen, block, stats);
+    }
+
+    void report(const char* name, uint32_t inRate, uint32_t outRate, uint32_t hlen,
+                uint32_t block, BlockStats& stats) {
+        const double mean = stats.mean() * 0.001;
+        const double p99 = stats.percentile(0.99) * 0.001;
+        const double max = stats.max() * 0.001;
+        const double msps = mean > 0.0 ? block / mean : 0.0;
+        printf("  %-10s %6u %6u %4u %7u %8zu %10.2f %10.2f %10.2f %12.2f\n", name, inRate,
+            outRate, hlen, block, stats.count(), mean, p99, max, msps);
+        if (csv) {
+            fprintf(csv, "%s,%u,%u,%u,%u,%zu,%.3f,%.3f,%.3f,%.3f\n", name, inRate, outRate,
+                hlen, block, stats.count(), mean, p99, max, msps);
+            fflush(csv);
+        }
+    }
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -b --sizes   list     block sizes (default 64,256,1024)\n"
+        "  -q --hlen    list     hlen values for the zita kernel\n"
+        "                        (default 8,16,24,32,48,64,96)\n"
+        "  -t --seconds sec      input audio per combination (default 1)\n"
+        "  -o --csv     path     write the result as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, ResampOptions* o) {
+    static const struct option longOptions[] = {
+        {"sizes",   required_argument, 0, 'b'},
+        {"hlen",    required_argument, 0, 'q'},
+        {"seconds", required_argument, 0, 't'},
+        {"csv",     required_argument, 0, 'o'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "b:q:t:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'b': if (!parseList(optarg, &o->sizes)) return false; break;
+            case 'q': if (!parseList(optarg, &o->hlens)) return false; break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return o->seconds > 0.0;
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::ResampOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+    bench::ResampBench b(o);
+    if (!b.open()) return 1;
+    b.fixedRate();
+    b.simple();
+    b.streaming();
+    b.buffer();
+    b.kernel();
+    b.close();
+    return 0;
+}
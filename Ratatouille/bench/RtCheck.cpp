@@ -0,0 +1,603 @@
+/*
+ * RtCheck.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_rtcheck - detect allocations and blocking calls
+ *                        in the real-time thread
+ *
+ *  Ratatouille_rtcheck define the allocator (malloc/free, new/delete),
+ *  the mutex and condition variable functions and a set of syscall
+ *  entry points itself, so that they interpose the libc/libstdc++
+ *  ones for the plugin loaded by BenchHost. While the plugin run()
+ *  executes, every call to one of them is a hit. For every distinct
+ *  call site a stack trace is printed to stderr. Calls from other
+ *  threads (worker, parallel processor) are not checked.
+ *
+ *  The plugin is driven through these scenarios:
+ *      run             blocks of noise, nothing loaded
+ *      patch_Get       with nothing loaded
+ *      patch_Set       model A, model B, IR A and IR B
+ *      normalisation   toggle the IR normalisation on and off
+ *      restore         state restore with all four files
+ *      patch_Get       with all files loaded
+ *      run             blocks of noise, all files loaded
+ *
+ *  When no files are given, a NAM WaveNet and a LSTM model from
+ *  ModelZoo, and two decaying noise IRs at 44.1kHz are written to a
+ *  temporary directory.
+ *
+ *  The exit code is 1 when a not allowed function was hit.
+ *
+ *  usage:
+ *      Ratatouille_rtcheck [options]
+ *        -p --plugin  path     plugin binary (default ./Ratatouille.so)
+ *        -r --rate    Hz       sample rate (default 48000)
+ *        -b --block   frames   block size (default 128)
+ *        -n --blocks  count    blocks per run scenario (default 2000)
+ *        -a --allow   list     comma separated function names to tolerate
+ *        -m --model-a path     model for slot A
+ *        -M --model-b path     model for slot B
+ *        -i --ir-a    path     IR file for the first convolver
+ *        -I --ir-b    path     IR file for the second convolver
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <cerrno>
+#include <cstdarg>
+#include <new>
+
+#include "BenchHost.h"
+#include "BenchUtil.h"
+#include "ModelZoo.h"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void  __libc_free(void* ptr);
+}
+
+namespace rtcheck {
+
+// set while the plugin run() executes, per thread
+static thread_local bool armed = false;
+
+struct Site {
+    uint64_t    hash;
+    const char* func;
+    const char* scenario;
+    size_t      count;
+};
+
+static const int maxSites = 128;
+static Site sites[maxSites];
+static int nSites = 0;
+static size_t hits = 0;
+static size_t tolerated = 0;
+static const char* scenario = "";
+static std::vector<std::string> allowed;
+
+static void enter() { armed = true; }
+static void leave() { armed = false; }
+
+static bool isAllowed(const char* func) {
+    for (auto& a : allowed) if (!strcmp(a.c_str(), func)) return true;
+    return false;
+}
+
+static void print(const char* fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        ssize_t r = ::write(STDERR_FILENO, buf, std::min<size_t>(n, sizeof(buf) - 1));
+        (void)r;
+    }
+}
+
+// called on entry of every interposed function
+static void hit(const char* func) {
+    if (!armed) return;
+    // no checks while we report
+    armed = false;
+    if (isAllowed(func)) {
+        tolerated++;
+        armed = true;
+        return;
+    }
+    hits++;
+    void* frames[32];
+    const int n = backtrace(frames, 32);
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 1; i < n; i++) hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+    for (int i = 0; i < nSites; i++) {
+        if (sites[i].hash == hash) {
+            sites[i].count++;
+            armed = true;
+            return;
+        }
+    }
+    if (nSites < maxSites) {
+        sites[nSites++] = { hash, func, scenario, 1 };
+        print("\nRatatouille_rtcheck: %s() called in run() [%s]\n", func, scenario);
+        backtrace_symbols_fd(frames + 1, n - 1, STDERR_FILENO);
+    }
+    armed = true;
+}
+
+// resolve the next definition of a interposed function
+template <class F>
+static inline F next(F& f, const char* name) {
+    if (!f) f = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+    return f;
+}
+
+} // end namespace rtcheck
+
+#define RT_NEXT(name) \
+    static decltype(&name) real_##name = nullptr; \
+    rtcheck::next(real_##name, #name)
+
+// the makefile build with -fvisibility=hidden,
+// the interposed functions must be exported
+#pragma GCC visibility push(default)
+
+////////////////////////////// ALLOCATOR ///////////////////////////////
+
+extern "C" {
+
+void* malloc(size_t size) {
+    rtcheck::hit("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    rtcheck::hit("calloc");
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    rtcheck::hit("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    if (ptr) rtcheck::hit("free");
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    rtcheck::hit("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    rtcheck::hit("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    rtcheck::hit("posix_memalign");
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+} // extern "C"
+
+// new and delete get there own name in the report,
+// the allocation itself is not reported a second time
+static inline void* rtNew(const char* func, size_t size) {
+    rtcheck::hit(func);
+    void* p = __libc_malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static inline void rtDelete(const char* func, void* ptr) {
+    if (ptr) rtcheck::hit(func);
+    __libc_free(ptr);
+}
+
+void* operator new(size_t size) { return rtNew("operator new", size); }
+void* operator new[](size_t size) { return rtNew("operator new[]", size); }
+void operator delete(void* ptr) noexcept { rtDelete("operator delete", ptr); }
+void operator delete[](void* ptr) noexcept { rtDelete("operator delete[]", ptr); }
+void operator delete(void* ptr, size_t) noexcept { rtDelete("operator delete", ptr); }
+void operator delete[](void* ptr, size_t) noexcept { rtDelete("operator delete[]", ptr); }
+
+/////////////////////////// LOCKS AND WAITS ////////////////////////////
+
+extern "C" {
+
+int pthread_mutex_lock(pthread_mutex_t* m) {
+    rtcheck::hit("pthread_mutex_lock");
+    RT_NEXT(pthread_mutex_lock);
+    return real_pthread_mutex_lock(m);
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t* m, const struct timespec* t) {
+    rtcheck::hit("pthread_mutex_timedlock");
+    RT_NEXT(pthread_mutex_timedlock);
+    return real_pthread_mutex_timedlock(m, t);
+}
+
+int pthread_cond_wait(pthread_cond_t* c, pthread_mutex_t* m) {
+    rtcheck::hit("pthread_cond_wait");
+    RT_NEXT(pthread_cond_wait);
+    return real_pthread_cond_wait(c, m);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* c, pthread_mutex_t* m, const struct timespec* t) {
+    rtcheck::hit("pthread_cond_timedwait");
+    RT_NEXT(pthread_cond_timedwait);
+    return real_pthread_cond_timedwait(c, m, t);
+}
+
+int pthread_cond_signal(pthread_cond_t* c) {
+    rtcheck::hit("pthread_cond_signal");
+    RT_NEXT(pthread_cond_signal);
+    return real_pthread_cond_signal(c);
+}
+
+int pthread_cond_broadcast(pthread_cond_t* c) {
+    rtcheck::hit("pthread_cond_broadcast");
+    RT_NEXT(pthread_cond_broadcast);
+    return real_pthread_cond_broadcast(c);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* l) {
+    rtcheck::hit("pthread_rwlock_rdlock");
+    RT_NEXT(pthread_rwlock_rdlock);
+    return real_pthread_rwlock_rdlock(l);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* l) {
+    rtcheck::hit("pthread_rwlock_wrlock");
+    RT_NEXT(pthread_rwlock_wrlock);
+    return real_pthread_rwlock_wrlock(l);
+}
+
+int sem_wait(sem_t* s) {
+    rtcheck::hit("sem_wait");
+    RT_NEXT(sem_wait);
+    return real_sem_wait(s);
+}
+
+int sem_post(sem_t* s) {
+    rtcheck::hit("sem_post");
+    RT_NEXT(sem_post);
+    return real_sem_post(s);
+}
+
+///////////////////////////// SYSCALLS /////////////////////////////////
+
+// std::atomic::wait/notify use syscall(SYS_futex, ...)
+long syscall(long number, ...) {
+    rtcheck::hit("syscall");
+    va_list ap;
+    va_start(ap, number);
+    long a[6];
+    for (int i = 0; i < 6; i++) a[i] = va_arg(ap, long);
+    va_end(ap);
+    RT_NEXT(syscall);
+    return real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+int open(const char* path, int flags, ...) {
+    rtcheck::hit("open");
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    RT_NEXT(open);
+    return real_open(path, flags, mode);
+}
+
+int close(int fd) {
+    rtcheck::hit("close");
+    RT_NEXT(close);
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+    rtcheck::hit("read");
+    RT_NEXT(read);
+    return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    rtcheck::hit("write");
+    RT_NEXT(write);
+    return real_write(fd, buf, count);
+}
+
+FILE* fopen(const char* path, const char* mode) {
+    rtcheck::hit("fopen");
+    RT_NEXT(fopen);
+    return real_fopen(path, mode);
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    rtcheck::hit("nanosleep");
+    RT_NEXT(nanosleep);
+    return real_nanosleep(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec* req, struct timespec* rem) {
+    rtcheck::hit("clock_nanosleep");
+    RT_NEXT(clock_nanosleep);
+    return real_clock_nanosleep(clock, flags, req, rem);
+}
+
+int usleep(useconds_t usec) {
+    rtcheck::hit("usleep");
+    RT_NEXT(usleep);
+    return real_usleep(usec);
+}
+
+int sched_yield(void) {
+    rtcheck::hit("sched_yield");
+    RT_NEXT(sched_yield);
+    return real_sched_yield();
+}
+
+int printf(const char* fmt, ...) {
+    rtcheck::hit("printf");
+    va_list ap;
+    va_start(ap, fmt);
+    const int r = vprintf(fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+int fprintf(FILE* f, const char* fmt, ...) {
+    rtcheck::hit("fprintf");
+    va_list ap;
+    va_start(ap, fmt);
+    const int r = vfprintf(f, fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+int puts(const char* s) {
+    rtcheck::hit("puts");
+    RT_NEXT(puts);
+    return real_puts(s);
+}
+
+} // extern "C"
+
+#pragma GCC visibility pop
+
+////////////////////////////// SCENARIOS ///////////////////////////////
+
+namespace bench {
+
+struct CheckOptions {
+    std::string plugin = "./Ratatouille.so";
+    uint32_t    rate = 48000;
+    uint32_t    block = 128;
+    uint32_t    blocks = 2000;
+    std::string modelA;
+    std::string modelB;
+    std::string irA;
+    std::string irB;
+};
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p --plugin  path     plugin binary (default ./Ratatouille.so)\n"
+        "  -r --rate    Hz       sample rate (default 48000)\n"
+        "  -b --block   frames   block size (default 128)\n"
+        "  -n --blocks  count    blocks per run scenario (default 2000)\n"
+        "  -a --allow   list     comma separated function names to tolerate\n"
+        "  -m --model-a path     model for slot A\n"
+        "  -M --model-b path     model for slot B\n"
+        "  -i --ir-a    path     IR file for the first convolver\n"
+        "  -I --ir-b    path     IR file for the second convolver\n", name);
+}
+
+static void parseAllow(const char* arg) {
+    std::string s(arg);
+    size_t start = 0;
+    while (start < s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        if (end > start) rtcheck::allowed.push_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions* o) {
+    static const struct option longOptions[] = {
+        {"plugin",  required_argument, 0, 'p'},
+        {"rate",    required_argument, 0, 'r'},
+        {"block",   required_argument, 0, 'b'},
+        {"blocks",  required_argument, 0, 'n'},
+        {"allow",   required_argument, 0, 'a'},
+        {"model-a", required_argument, 0, 'm'},
+        {"model-b", required_argument, 0, 'M'},
+        {"ir-a",    required_argument, 0, 'i'},
+        {"ir-b",    required_argument, 0, 'I'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:r:b:n:a:m:M:i:I:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'p': o->plugin = optarg; break;
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'b': o->block = strtoul(optarg, nullptr, 10); break;
+            case 'n': o->blocks = strtoul(optarg, nullptr, 10); break;
+            case 'a': parseAllow(optarg); break;
+            case 'm': o->modelA = optarg; break;
+            case 'M': o->modelB = optarg; break;
+            case 'i': o->irA = optarg; break;
+            case 'I': o->irB = optarg; break;
+            default: return false;
+        }
+    }
+    return o->rate && o->block;
+}
+
+class Checker
+{
+public:
+    Checker(BenchHost& host_, const CheckOptions& o_) : host(host_), o(o_), failed(false) {
+        source.setup("noise", o.rate);
+    }
+
+    void runBlocks(const char* name) {
+        begin(name);
+        for (uint32_t i = 0; i < o.blocks; i++) {
+            source.fill(host.input(), o.block);
+            host.run(o.block);
+        }
+        end();
+    }
+
+    void get(const char* name) {
+        begin(name);
+        host.sendGet();
+        host.run(o.block);
+        end();
+    }
+
+    void set(const char* name, const char* property, const std::string& file) {
+        begin(name);
+        if (!host.loadFile(host.map(property), file.c_str())) fail(name);
+        end();
+    }
+
+    // toggle the normalisation of a convolver, wait for the reload
+    void normalise(const char* name, uint32_t port) {
+        begin(name);
+        std::string value;
+        for (float v : {1.0f, 0.0f}) {
+            *host.control(port) = v;
+            if (!host.runUntilEcho(host.map(XLV2__MODELFILE), &value)) fail(name);
+        }
+        end();
+    }
+
+    void restore(const char* name) {
+        begin(name);
+        if (!host.restore(o.modelA.c_str(), o.modelB.c_str(), o.irA.c_str(), o.irB.c_str()))
+            fail(name);
+        end();
+    }
+
+    bool ok() const { return !failed && !rtcheck::hits; }
+
+private:
+    BenchHost&          host;
+    const CheckOptions& o;
+    SignalSource        source;
+    bool                failed;
+    size_t              startHits;
+
+    void begin(const char* name) {
+        rtcheck::scenario = name;
+        startHits = rtcheck::hits;
+    }
+
+    void end() {
+        const size_t n = rtcheck::hits - startHits;
+        printf("  %-24s %s", rtcheck::scenario, n ? "FAIL" : "ok");
+        if (n) printf(" (%zu hits)", n);
+        printf("\n");
+    }
+
+    void fail(const char* name) {
+        fprintf(stderr, "Ratatouille_rtcheck: %s fail\n", name);
+        failed = true;
+    }
+};
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::CheckOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+    // backtrace() load libgcc on the first call, do it now
+    void* warm[2];
+    backtrace(warm, 2);
+
+    char tmp[] = "/tmp/Ratatouille_rtcheck.XXXXXX";
+    std::vector<std::string> generated;
+    if (o.modelA.empty() || o.modelB.empty() || o.irA.empty() || o.irB.empty()) {
+        if (!mkdtemp(tmp)) {
+            fprintf(stderr, "Ratatouille_rtcheck: fail to create temporary directory\n");
+            return 1;
+        }
+        bench::ModelZoo zoo;
+        if (!zoo.write(tmp, 48000)) return 1;
+        for (auto& m : zoo.models()) {
+            generated.push_back(m.file);
+            if (o.modelA.empty() && m.name == "wavenet-nano") o.modelA = m.file;
+            if (o.modelB.empty() && m.name == "lstm-16") o.modelB = m.file;
+        }
+        const std::string dir(tmp);
+        if (o.irA.empty()) {
+            o.irA = dir + "/ir-a.wav";
+            generated.push_back(o.irA);
+            if (!bench::writeIR(o.irA, 8192, 44100)) return 1;
+        }
+        if (o.irB.empty()) {
+            o.irB = dir + "/ir-b.wav";
+            generated.push_back(o.irB);
+            if (!bench::writeIR(o.irB, 8192, 44100)) return 1;
+        }
+    }
+
+    int ret = 1;
+    bench::BenchHost host;
+    if (host.load(o.plugin.c_str(), o.rate, o.block)) {
+        host.setRunGuard(&rtcheck::enter, &rtcheck::leave);
+        printf("Ratatouille_rtcheck: %u Hz, %u frames\n", o.rate, o.block);
+        bench::Checker check(host, o);
+        check.runBlocks("run (empty)");
+        check.get("patch_Get (empty)");
+        check.set("patch_Set model A", XLV2__MODELFILE, o.modelA);
+        check.set("patch_Set model B", XLV2__MODELFILE1, o.modelB);
+        check.set("patch_Set IR A", XLV2__IRFILE, o.irA);
+        check.set("patch_Set IR B", XLV2__IRFILE1, o.irB);
+        check.normalise("normalisation IR A", bench::NORM_A);
+        check.normalise("normalisation IR B", bench::NORM_B);
+        check.restore("state restore");
+        check.get("patch_Get (loaded)");
+        check.runBlocks("run (loaded)");
+        host.setRunGuard(nullptr, nullptr);
+        printf("Ratatouille_rtcheck: %zu hits at %d call sites, %zu tolerated\n",
+            rtcheck::hits, rtcheck::nSites, rtcheck::tolerated);
+        for (int i = 0; i < rtcheck::nSites; i++)
+            printf("  %-24s %-24s %zu\n", rtcheck::sites[i].scenario, rtcheck::sites[i].func,
+                rtcheck::sites[i].count);
+        ret = check.ok() ? 0 : 1;
+    }
+    host.unload();
+    for (auto& f : generated) unlink(f.c_str());
+    if (!generated.empty()) rmdir(tmp);
+    return ret;
+}
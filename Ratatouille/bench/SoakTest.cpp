@@ -0,0 +1,436 @@
+/*
+ * SoakTest.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_soak - long running test of the processing chain
+ *                     under CPU contention and patch:Set storms
+ *
+ *  The plugin is loaded with BenchHost and run paced in real-time,
+ *  one block per period, while busy threads load all CPUs. At random
+ *  times (exponential distributed with the given mean) one of these
+ *  events is send to the plugin:
+ *      model-a, model-b, ir-a, ir-b   patch:Set with a random file
+ *      restore                        state restore with random files
+ *      norm                           toggle a normalisation switch
+ *  Every fourth event is a storm, 2 to 8 events in consecutive blocks,
+ *  so most of them arrive while the worker is still busy.
+ *
+ *  Counted are, per report interval and in total:
+ *      overrun     run() took longer than the block budget
+ *      late        the host thread woke up later than a block budget
+ *      fallback    pro.getProcess() fail, slot B or conv1 run inline
+ *      timeout     expired waits of the parallel processor
+ *                  (the longest wait is reported at the end)
+ *      dropped     pro.processWait() gave up, the output of slot B
+ *                  or conv1 for this block is incomplete
+ *      nonfinite   blocks with NaN or Inf in the output
+ *      sent/done   load requests send, loads notified by the plugin
+ *  The ParallelThread counters are read by the XLV2__PROFILE extension.
+ *
+ *  The test fail (exit code 1) when a block was dropped or the output
+ *  was not finite. Stop it early with Ctrl-C, the final report is
+ *  written anyway.
+ *
+ *  When no files are given, the models of ModelZoo and two decaying
+ *  noise IRs (44.1kHz and 48kHz) are written to a temporary directory.
+ *
+ *  usage:
+ *      Ratatouille_soak [options]
+ *        -p --plugin   path     plugin binary (default ./Ratatouille.so)
+ *        -r --rate     Hz       sample rate (default 48000)
+ *        -b --block    frames   block size (default 128)
+ *        -t --seconds  sec      test duration (default 3600)
+ *        -i --interval sec      report interval (default 60)
+ *        -e --events   sec      mean time between events (default 2)
+ *        -s --stress   count    busy threads (default one per CPU)
+ *        -S --seed     number   random seed (default 1)
+ *        -F --fifo              run the host thread with SCHED_FIFO
+ *        -f --file     path     model or IR (*.wav) to load, could be repeated
+ *        -o --csv      path     write the interval reports as CSV to path
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <random>
+
+#include "BenchHost.h"
+#include "BenchUtil.h"
+#include "ModelZoo.h"
+
+namespace bench {
+
+struct SoakOptions {
+    std::string plugin = "./Ratatouille.so";
+    uint32_t    rate = 48000;
+    uint32_t    block = 128;
+    double      seconds = 3600.0;
+    double      interval = 60.0;
+    double      events = 2.0;
+    int         stress = -1;
+    uint32_t    seed = 1;
+    bool        fifo = false;
+    std::vector<std::string> files;
+    std::string csv;
+};
+
+enum SoakEvent { EV_MODEL_A, EV_MODEL_B, EV_IR_A, EV_IR_B, EV_RESTORE, EV_NORM, EV_COUNT };
+
+// the counters of one report interval
+struct SoakCounts {
+    uint64_t blocks = 0;
+    uint64_t overruns = 0;
+    uint64_t late = 0;
+    uint64_t fallbacks = 0;
+    uint64_t timeouts = 0;
+    uint64_t dropped = 0;
+    uint64_t workerTimeouts = 0;
+    uint64_t nonfinite = 0;
+    uint64_t sent = 0;
+    uint64_t done = 0;
+    int64_t  maxRun = 0;
+
+    void add(const SoakCounts& c) {
+        blocks += c.blocks;
+        overruns += c.overruns;
+        late += c.late;
+        fallbacks += c.fallbacks;
+        timeouts += c.timeouts;
+        dropped += c.dropped;
+        workerTimeouts += c.workerTimeouts;
+        nonfinite += c.nonfinite;
+        sent += c.sent;
+        done += c.done;
+        maxRun = std::max(maxRun, c.maxRun);
+    }
+};
+
+static volatile sig_atomic_t stopRequest = 0;
+
+static void onSignal(int) {
+    stopRequest = 1;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -p --plugin   path     plugin binary (default ./Ratatouille.so)\n"
+        "  -r --rate     Hz       sample rate (default 48000)\n"
+        "  -b --block    frames   block size (default 128)\n"
+        "  -t --seconds  sec      test duration (default 3600)\n"
+        "  -i --interval sec      report interval (default 60)\n"
+        "  -e --events   sec      mean time between events (default 2)\n"
+        "  -s --stress   count    busy threads (default one per CPU)\n"
+        "  -S --seed     number   random seed (default 1)\n"
+        "  -F --fifo              run the host thread with SCHED_FIFO\n"
+        "  -f --file     path     model or IR (*.wav) to load, could be repeated\n"
+        "  -o --csv      path     write the interval reports as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, SoakOptions* o) {
+    static const struct option longOptions[] = {
+        {"plugin",   required_argument, 0, 'p'},
+        {"rate",     required_argument, 0, 'r'},
+        {"block",    required_argument, 0, 'b'},
+        {"seconds",  required_argument, 0, 't'},
+        {"interval", required_argument, 0, 'i'},
+        {"events",   required_argument, 0, 'e'},
+        {"stress",   required_argument, 0, 's'},
+        {"seed",     required_argument, 0, 'S'},
+        {"fifo",     no_argument,       0, 'F'},
+        {"file",     required_argument, 0, 'f'},
+        {"csv",      required_argument, 0, 'o'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:r:b:t:i:e:s:S:Ff:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'p': o->plugin = optarg; break;
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'b': o->block = strtoul(optarg, nullptr, 10); break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'i': o->interval = strtod(optarg, nullptr); break;
+            case 'e': o->events = strtod(optarg, nullptr); break;
+            case 's': o->stress = atoi(optarg); break;
+            case 'S': o->seed = strtoul(optarg, nullptr, 10); break;
+            case 'F': o->fifo = true; break;
+            case 'f': o->files.push_back(optarg); break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return o->rate && o->block && o->seconds > 0.0 && o->interval > 0.0 && o->events > 0.0;
+}
+
+static inline bool isIR(const std::string& f) {
+    return f.size() > 4 && f.compare(f.size() - 4, 4, ".wav") == 0;
+}
+
+class Soak
+{
+public:
+    Soak(BenchHost& h, const SoakOptions& o_, const std::vector<std::string>& models_,
+         const std::vector<std::string>& irs_)
+        : host(h), o(o_), models(models_), irs(irs_), rng(o_.seed), storm(0) {}
+
+    // send the next event when it is due
+    void events(SoakCounts* c) {
+        if (storm) {
+            storm--;
+            send(c);
+            return;
+        }
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        // probability for one event in this block
+        if (u(rng) >= o.block / (o.rate * o.events)) return;
+        if (u(rng) < 0.25) storm = std::uniform_int_distribution<int>(1, 7)(rng);
+        send(c);
+    }
+
+private:
+    BenchHost& host;
+    const SoakOptions& o;
+    const std::vector<std::string>& models;
+    const std::vector<std::string>& irs;
+    std::mt19937 rng;
+    int storm;
+
+    const std::string& pick(const std::vector<std::string>& list) {
+        return list[std::uniform_int_distribution<size_t>(0, list.size() - 1)(rng)];
+    }
+
+    void send(SoakCounts* c) {
+        switch (std::uniform_int_distribution<int>(0, EV_COUNT - 1)(rng)) {
+            case EV_MODEL_A: host.sendFile(host.map(XLV2__MODELFILE), pick(models).c_str()); break;
+            case EV_MODEL_B: host.sendFile(host.map(XLV2__MODELFILE1), pick(models).c_str()); break;
+            case EV_IR_A:    host.sendFile(host.map(XLV2__IRFILE), pick(irs).c_str()); break;
+            case EV_IR_B:    host.sendFile(host.map(XLV2__IRFILE1), pick(irs).c_str()); break;
+            case EV_RESTORE:
+                if (!host.sendState(pick(models).c_str(), pick(models).c_str(),
+                                    pick(irs).c_str(), pick(irs).c_str())) return;
+                break;
+            case EV_NORM: {
+                float* norm = host.control(std::uniform_int_distribution<int>(0, 1)(rng) ?
+                    NORM_A : NORM_B);
+                *norm = *norm > 0.5f ? 0.0f : 1.0f;
+                break;
+            }
+        }
+        c->sent++;
+    }
+};
+
+static void report(double elapsed, const SoakCounts& c, double budget, FILE* out) {
+    fprintf(out, "  %9.0f %9llu %8llu %8llu %8llu %8llu %8llu %9llu %6llu %6llu %9.1f%%\n",
+        elapsed, (unsigned long long)c.blocks, (unsigned long long)c.overruns,
+        (unsigned long long)c.late, (unsigned long long)c.fallbacks,
+        (unsigned long long)c.timeouts, (unsigned long long)c.dropped,
+        (unsigned long long)c.nonfinite, (unsigned long long)c.sent,
+        (unsigned long long)c.done, 100.0 * c.maxRun / budget);
+    fflush(out);
+}
+
+static void reportCsv(double elapsed, const SoakCounts& c, double budget, FILE* csv) {
+    fprintf(csv, "%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.2f,%.2f\n", elapsed,
+        (unsigned long long)c.blocks, (unsigned long long)c.overruns,
+        (unsigned long long)c.late, (unsigned long long)c.fallbacks,
+        (unsigned long long)c.timeouts, (unsigned long long)c.dropped,
+        (unsigned long long)c.workerTimeouts, (unsigned long long)c.nonfinite,
+        (unsigned long long)c.sent, (unsigned long long)c.done, c.maxRun * 0.001, budget * 0.001);
+    fflush(csv);
+}
+
+static bool setFifo(pthread_t thread, int prio) {
+    sched_param param;
+    param.sched_priority = prio;
+    return pthread_setschedparam(thread, SCHED_FIFO, &param) == 0;
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::SoakOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> models;
+    std::vector<std::string> irs;
+    for (auto& f : o.files) (bench::isIR(f) ? irs : models).push_back(f);
+
+    // write default resources for the missing kind of files
+    char tmp[] = "/tmp/Ratatouille_soak.XXXXXX";
+    std::vector<std::string> generated;
+    if (models.empty() || irs.empty()) {
+        if (!mkdtemp(tmp)) {
+            fprintf(stderr, "Ratatouille_soak: fail to create temporary directory\n");
+            return 1;
+        }
+        const std::string dir(tmp);
+        bench::ModelZoo zoo;
+        if (!zoo.write(dir, 48000)) return 1;
+        for (auto& m : zoo.models()) generated.push_back(m.file);
+        if (models.empty()) {
+            for (auto& m : zoo.models()) models.push_back(m.file);
+        }
+        if (irs.empty()) {
+            const struct { const char* name; uint32_t rate; } defaultIRs[] = {
+                { "/ir-44100.wav", 44100 }, { "/ir-48000.wav", 48000 }
+            };
+            for (auto& ir : defaultIRs) {
+                irs.push_back(dir + ir.name);
+                generated.push_back(irs.back());
+                if (!bench::writeIR(irs.back(), ir.rate / 2, ir.rate)) return 1;
+            }
+        }
+    }
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_soak: fail to open %s\n", o.csv.c_str());
+            return 1;
+        }
+        fprintf(csv, "seconds,blocks,overruns,late,fallbacks,timeouts,dropped,worker_timeouts,"
+                     "nonfinite,sent,done,max_run_us,budget_us\n");
+    }
+
+    int ret = 0;
+    bench::BenchHost host;
+    bench::Background background;
+    if (!host.load(o.plugin.c_str(), o.rate, o.block)) {
+        ret = 1;
+    } else if (!host.profile() || !host.profile()->pro) {
+        fprintf(stderr, "Ratatouille_soak: %s don't provide %s\n", o.plugin.c_str(), XLV2__PROFILE);
+        ret = 1;
+    } else {
+        const ratatouille::Profile* profile = host.profile();
+        // start with all slots loaded, so that the parallel processor runs
+        host.restore(models.front().c_str(), models.back().c_str(),
+                     irs.front().c_str(), irs.back().c_str());
+
+        signal(SIGINT, bench::onSignal);
+        signal(SIGTERM, bench::onSignal);
+        // start the background load first, threads inherit the policy
+        if (o.stress != 0) background.start(o.stress < 0 ? 0 : o.stress);
+        const pthread_t self = pthread_self();
+        if (o.fifo && !bench::setFifo(self, sched_get_priority_max(SCHED_FIFO) / 5 + 1))
+            fprintf(stderr, "Ratatouille_soak: no permission for SCHED_FIFO, run without\n");
+
+        printf("Ratatouille_soak: %u Hz, %u frames, %.0f s, %zu models, %zu IRs, seed %u\n",
+            o.rate, o.block, o.seconds, models.size(), irs.size(), o.seed);
+        printf("  %9s %9s %8s %8s %8s %8s %8s %9s %6s %6s %10s\n", "seconds", "blocks",
+            "overrun", "late", "fallback", "timeout", "dropped", "nonfinite", "sent", "done",
+            "max run");
+
+        const double budget = bench::blockBudget(o.block, o.rate);
+        const int64_t period = static_cast<int64_t>(budget);
+        bench::SignalSource source;
+        source.setup("noise", o.rate);
+        bench::Soak soak(host, o, models, irs);
+        bench::SoakCounts total;
+        bench::SoakCounts interval;
+        uint32_t fallbacks = profile->pro->fallbacks.load(std::memory_order_relaxed);
+        uint32_t timeouts = profile->pro->timeouts.load(std::memory_order_relaxed);
+        uint32_t dropped = profile->pro->dropped.load(std::memory_order_relaxed);
+        uint32_t workerTimeouts = profile->worker->timeouts.load(std::memory_order_relaxed);
+        uint32_t serial = profile->load.serial.load(std::memory_order_acquire);
+
+        const int64_t start = ratatouille::profileNow();
+        int64_t lastReport = start;
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while (!bench::stopRequest) {
+            next.tv_nsec += period;
+            while (next.tv_nsec >= 1000000000) {
+                next.tv_nsec -= 1000000000;
+                next.tv_sec += 1;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            const int64_t wake = (now.tv_sec - next.tv_sec) * 1000000000LL + now.tv_nsec - next.tv_nsec;
+            if (wake > period) {
+                interval.late++;
+                // don't try to catch up, start a new period
+                next = now;
+            }
+
+            soak.events(&interval);
+            source.fill(host.input(), o.block);
+            const int64_t t = host.runTimed(o.block);
+            interval.blocks++;
+            interval.maxRun = std::max(interval.maxRun, t);
+            if (t > budget) interval.overruns++;
+            const float* out = host.output();
+            for (uint32_t i = 0; i < o.block; i++) {
+                if (!std::isfinite(out[i])) {
+                    interval.nonfinite++;
+                    break;
+                }
+            }
+
+            // the counters are written by the audio thread only,
+            // which is this thread, so the deltas are exact
+            const uint32_t f = profile->pro->fallbacks.load(std::memory_order_relaxed);
+            const uint32_t to = profile->pro->timeouts.load(std::memory_order_relaxed);
+            const uint32_t d = profile->pro->dropped.load(std::memory_order_relaxed);
+            const uint32_t w = profile->worker->timeouts.load(std::memory_order_relaxed);
+            const uint32_t s = profile->load.serial.load(std::memory_order_acquire);
+            interval.fallbacks += f - fallbacks;
+            interval.timeouts += to - timeouts;
+            interval.dropped += d - dropped;
+            interval.workerTimeouts += w - workerTimeouts;
+            interval.done += s - serial;
+            fallbacks = f;
+            timeouts = to;
+            dropped = d;
+            workerTimeouts = w;
+            serial = s;
+
+            const int64_t n = ratatouille::profileNow();
+            const bool finished = (n - start) * 1e-9 >= o.seconds;
+            if ((n - lastReport) * 1e-9 >= o.interval || finished) {
+                bench::report((n - start) * 1e-9, interval, budget, stdout);
+                if (csv) bench::reportCsv((n - start) * 1e-9, interval, budget, csv);
+                total.add(interval);
+                interval = bench::SoakCounts();
+                lastReport = n;
+            }
+            if (finished) break;
+        }
+        total.add(interval);
+        background.stop();
+
+        const double elapsed = (ratatouille::profileNow() - start) * 1e-9;
+        printf("  total\n");
+        bench::report(elapsed, total, budget, stdout);
+        printf("  budget %.2f us, worker timeouts %llu, %.4f%% of the blocks overrun\n",
+            budget * 0.001, (unsigned long long)total.workerTimeouts,
+            total.blocks ? 100.0 * total.overruns / total.blocks : 0.0);
+        printf("  longest wait for the parallel processor %.2f us\n",
+            profile->pro->maxWaitNs.load(std::memory_order_relaxed) * 0.001);
+        if (total.dropped || total.nonfinite) {
+            printf("Ratatouille_soak: FAIL, %llu dropped blocks, %llu blocks with NaN/Inf\n",
+                (unsigned long long)total.dropped, (unsigned long long)total.nonfinite);
+            ret = 1;
+        } else {
+            printf("Ratatouille_soak: PASS\n");
+        }
+    }
+    host.unload();
+    if (csv) fclose(csv);
+    for (auto& f : generated) unlink(f.c_str());
+    if (!generated.empty()) rmdir(tmp);
+    return ret;
+}
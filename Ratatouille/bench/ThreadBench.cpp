@@ -0,0 +1,258 @@
+/*
+ * ThreadBench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2024 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+ ** Ratatouille_threadbench - round trip latency of the ParallelThread
+ *                            handshake
+ *
+ *  The main thread play the audio thread: once per period (block size
+ *  / sample rate) it do the same as Xratatouille::run_dsp_() with the
+ *  parallel processor:
+ *      if (pro.getProcess()) pro.runProcess(); ... pro.processWait();
+ *  and measure the time from getProcess() to the return of processWait().
+ *  The processed function only take a time stamp, so the round trip is
+ *  pure handshake cost. The wake time is the time from runProcess()
+ *  until the function runs in the parallel thread.
+ *
+ *  The handshake depends on the language level ParallelThread is build
+ *  with, std::atomic::wait with c++20, with c++17 a futex on linux and
+ *  std::condition_variable else.
+ *  The makefile build this file twice, Ratatouille_threadbench with the
+ *  default level and Ratatouille_threadbench17 with -std=c++17.
+ *
+ *  Every run is done in three modes:
+ *      idle    nothing else runs
+ *      load    one busy thread per CPU runs in background
+ *      fifo    main and parallel thread run with SCHED_FIFO
+ *              (needs rtprio permission, skipped otherwise),
+ *              with background load
+ *
+ *  Reported is p50/p99/p99.9/max of the round trip and the wake time,
+ *  the round trip as fraction of the block budget, and how often
+ *  getProcess() fail (the function then runs in the main thread).
+ *
+ *  usage:
+ *      Ratatouille_threadbench [options]
+ *        -r --rate    Hz       sample rate (default 48000)
+ *        -b --sizes   list     block sizes (default 32,64,128)
+ *        -t --seconds sec      time measured per mode and block size (default 5)
+ *        -B --busy             no pacing, run the handshake back to back
+ *        -o --csv     path     write the result as CSV to path
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <chrono>
+#include <thread>
+
+#include "ParallelThread.h"
+
+#include "BenchUtil.h"
+
+namespace bench {
+
+#if __cplusplus > 201703L
+static const char* const handshake = "c++20 (atomic::wait)";
+#elif defined(PARALLEL_THREAD_FUTEX)
+static const char* const handshake = "c++17 (futex)";
+#else
+static const char* const handshake = "c++17 (condition_variable)";
+#endif
+
+struct ThreadOptions {
+    uint32_t    rate = 48000;
+    std::vector<uint32_t> sizes = {32, 64, 128};
+    double      seconds = 5.0;
+    bool        busy = false;
+    std::string csv;
+};
+
+enum Mode { MODE_IDLE, MODE_LOAD, MODE_FIFO, MODE_COUNT };
+static const char* const modeNames[MODE_COUNT] = { "idle", "load", "fifo" };
+
+static inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the function to run in the parallel thread
+class Probe
+{
+public:
+    std::atomic<int64_t> started;
+    Probe() : started(0) {}
+    void process() {
+        started.store(nowNs(), std::memory_order_release);
+    }
+};
+
+struct ThreadResult {
+    BlockStats roundTrip;
+    BlockStats wake;
+    size_t     fallbacks = 0;
+};
+
+static bool setFifo(pthread_t thread, int prio) {
+    sched_param param;
+    param.sched_priority = prio;
+    return pthread_setschedparam(thread, SCHED_FIFO, &param) == 0;
+}
+
+static void measure(uint32_t rate, uint32_t block, double seconds, bool busy, bool fifo,
+                    ThreadResult* res) {
+    Probe probe;
+    ParallelThread pro;
+    pro.start();
+    pro.setThreadName("RT");
+    if (fifo) pro.setPriority(0, SCHED_FIFO);
+    pro.setTimeOut(std::max(100,static_cast<int>((block/(rate*0.000001))*0.1)));
+    pro.set<Probe, &Probe::process>(&probe);
+
+    const int64_t period = static_cast<int64_t>(blockBudget(block, rate));
+    const uint32_t blocks = std::max<uint32_t>(100, static_cast<uint32_t>(seconds * rate / block));
+    const uint32_t warmup = std::max<uint32_t>(10, blocks / 20);
+    res->roundTrip.clear();
+    res->wake.clear();
+    res->roundTrip.reserve(blocks);
+    res->wake.reserve(blocks);
+    res->fallbacks = 0;
+
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t i = 0; i < warmup + blocks; i++) {
+        if (!busy) {
+            next.tv_nsec += period;
+            while (next.tv_nsec >= 1000000000) {
+                next.tv_nsec -= 1000000000;
+                next.tv_sec += 1;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+        }
+        const int64_t t0 = nowNs();
+        int64_t triggered = 0;
+        bool parallel = pro.getProcess();
+        if (parallel) {
+            triggered = nowNs();
+            pro.runProcess();
+        } else {
+            probe.process();
+        }
+        pro.processWait();
+        const int64_t t1 = nowNs();
+        if (i < warmup) continue;
+        res->roundTrip.add(t1 - t0);
+        if (parallel) res->wake.add(probe.started.load(std::memory_order_acquire) - triggered);
+        else res->fallbacks++;
+    }
+    pro.stop();
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -r --rate    Hz       sample rate (default 48000)\n"
+        "  -b --sizes   list     block sizes (default 32,64,128)\n"
+        "  -t --seconds sec      time measured per mode and block size (default 5)\n"
+        "  -B --busy             no pacing, run the handshake back to back\n"
+        "  -o --csv     path     write the result as CSV to path\n", name);
+}
+
+static bool parseOptions(int argc, char** argv, ThreadOptions* o) {
+    static const struct option longOptions[] = {
+        {"rate",    required_argument, 0, 'r'},
+        {"sizes",   required_argument, 0, 'b'},
+        {"seconds", required_argument, 0, 't'},
+        {"busy",    no_argument,       0, 'B'},
+        {"csv",     required_argument, 0, 'o'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "r:b:t:Bo:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'r': o->rate = strtoul(optarg, nullptr, 10); break;
+            case 'b': if (!parseList(optarg, &o->sizes)) return false; break;
+            case 't': o->seconds = strtod(optarg, nullptr); break;
+            case 'B': o->busy = true; break;
+            case 'o': o->csv = optarg; break;
+            default: return false;
+        }
+    }
+    return o->rate && o->seconds > 0.0;
+}
+
+} // end namespace bench
+
+int main(int argc, char** argv) {
+    bench::ThreadOptions o;
+    if (!bench::parseOptions(argc, argv, &o)) {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    FILE* csv = nullptr;
+    if (!o.csv.empty()) {
+        csv = fopen(o.csv.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Ratatouille_threadbench: fail to open %s\n", o.csv.c_str());
+            return 1;
+        }
+        fprintf(csv, "handshake,mode,rate,block,blocks,budget_us,rt_p50_us,rt_p99_us,rt_p999_us,"
+                     "rt_max_us,wake_p50_us,wake_p99_us,wake_max_us,p99_load,fallbacks\n");
+    }
+
+    printf("Ratatouille_threadbench: %s, %u Hz%s\n", bench::handshake, o.rate,
+        o.busy ? ", back to back" : "");
+    printf("  %-5s %6s %9s %9s %9s %9s %9s %9s %9s %8s %9s\n", "mode", "block", "rt p50",
+        "rt p99", "rt p99.9", "rt max", "wake p50", "wake p99", "wake max", "p99 load",
+        "fallback");
+
+    const pthread_t self = pthread_self();
+    sched_param oldParam;
+    int oldPolicy;
+    pthread_getschedparam(self, &oldPolicy, &oldParam);
+
+    bench::Background background;
+    bench::ThreadResult res;
+    for (int mode = 0; mode < bench::MODE_COUNT; mode++) {
+        const bool fifo = mode == bench::MODE_FIFO;
+        // start the background load first, threads inherit the policy
+        if (mode != bench::MODE_IDLE) background.start();
+        if (fifo && !bench::setFifo(self, sched_get_priority_max(SCHED_FIFO) / 5 + 1)) {
+            fprintf(stderr, "Ratatouille_threadbench: no permission for SCHED_FIFO, skip fifo mode\n");
+            background.stop();
+            continue;
+        }
+        for (auto block : o.sizes) {
+            bench::measure(o.rate, block, o.seconds, o.busy, fifo, &res);
+            const double budget = bench::blockBudget(block, o.rate) * 0.001;
+            const double p50 = res.roundTrip.percentile(0.5) * 0.001;
+            const double p99 = res.roundTrip.percentile(0.99) * 0.001;
+            const double p999 = res.roundTrip.percentile(0.999) * 0.001;
+            const double max = res.roundTrip.max() * 0.001;
+            const double w50 = res.wake.percentile(0.5) * 0.001;
+            const double w99 = res.wake.percentile(0.99) * 0.001;
+            const double wmax = res.wake.max() * 0.001;
+            printf("  %-5s %6u %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %7.2f%% %9zu\n",
+                bench::modeNames[mode], block, p50, p99, p999, max, w50, w99, wmax,
+                100.0 * p99 / budget, res.fallbacks);
+            if (csv) {
+                fprintf(csv, "%s,%s,%u,%u,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%zu\n",
+                    bench::handshake, bench::modeNames[mode], o.rate, block,
+                    res.roundTrip.count(), budget, p50, p99, p999, max, w50, w99, wmax,
+                    p99 / budget, res.fallbacks);
+                fflush(csv);
+            }
+        }
+        background.stop();
+        if (fifo) pthread_setschedparam(self, oldPolicy, &oldParam);
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
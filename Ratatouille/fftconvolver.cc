@@ -102,6 +102,37 @@ int Audiofile::read(float *data, uint32_t frames) {
     return sf_readf_float(_sndfile, data, frames);
 }
 
+// bytes allocated by fftconvolver::FFTConvolver::init(blockSize, ir, irLen),
+// computed from its layout as the buffers are private: the IR and the
+// input spectrum of each segment, the pre-multiplied and convolved
+// spectrum, the FFT buffer, overlap and input buffer and the FFT work space
+static size_t fft_convolver_memory(size_t blockSize, size_t irLen)
+{
+    if (!irLen) return 0;
+    size_t block = 1;
+    while (block < blockSize) block *= 2;
+    const size_t segSize = 2 * block;
+    const size_t segCount = (irLen + block - 1) / block;
+    const size_t complexSize = segSize / 2 + 1;
+    return sizeof(float) * ((2 * segCount + 2) * 2 * complexSize + 3 * segSize + 2 * block);
+}
+
+// the same for fftconvolver::TwoStageFFTConvolver::init(), a head,
+// a first tail with the head block size and the remaining tail
+static size_t two_stage_convolver_memory(size_t headBlockSize, size_t tailBlockSize, size_t irLen)
+{
+    size_t head = 1;
+    while (head < headBlockSize) head *= 2;
+    size_t tail = 1;
+    while (tail < tailBlockSize) tail *= 2;
+    size_t bytes = fft_convolver_memory(head, std::min(irLen, tail));
+    if (irLen > tail)
+        bytes += fft_convolver_memory(head, std::min(irLen - tail, tail)) + 2 * tail * sizeof(float);
+    if (irLen > 2 * tail)
+        bytes += fft_convolver_memory(tail, irLen - 2 * tail) + 4 * tail * sizeof(float);
+    return bytes;
+}
+
 /****************************************************************
  ** DoubleThreadConvolver
  */
@@ -124,6 +155,7 @@ void DoubleThreadConvolver::waitForBackgroundProcessing()
 bool DoubleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32_t *rate, int *asize)
 {
     Audiofile audio;
+    ratatouille::PhaseTimer readTimer(profile, ratatouille::PHASE_READ);
     if (audio.open_read(fname)) {
         fprintf(stderr, "Unable to open %s\n", fname.c_str() );
         *buffer = 0;
@@ -163,8 +195,11 @@ bool DoubleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32
     }
     *buffer = cbuffer;
     audio.close();
+    readTimer.stop();
     if (*rate != samplerate) {
-        *buffer = resamp.process(*rate, *asize, *buffer, samplerate, asize);
+        ratatouille::PhaseTimer t(profile, ratatouille::PHASE_RESAMPLE);
+        *buffer = resamp.process(*rate, *asize, cbuffer, samplerate, asize);
+        delete[] cbuffer;
         if (!*buffer) {
             printf("no buffer\n");
             return false;
@@ -233,7 +268,13 @@ bool DoubleThreadConvolver::configure(std::string fname, float gain, unsigned in
     */
     uint32_t _tail = _head > 8192 ? _head : 8192;
     //fprintf(stderr, "head %i tail %i irlen %i \n", _head, _tail, asize);
-    if (init(_head, _tail, abuf, asize)) {
+    bool ret;
+    {
+        ratatouille::PhaseTimer t(profile, ratatouille::PHASE_PARTITION);
+        ret = init(_head, _tail, abuf, asize);
+    }
+    if (ret) {
+        memory = two_stage_convolver_memory(_head, _tail, asize);
         ready = true;
         delete[] abuf;
         return true;
@@ -254,6 +295,7 @@ void DoubleThreadConvolver::compute(int32_t count, float* input, float* output)
 bool SingleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32_t *rate, int *asize)
 {
     Audiofile audio;
+    ratatouille::PhaseTimer readTimer(profile, ratatouille::PHASE_READ);
     if (audio.open_read(fname)) {
         fprintf(stderr, "Unable to open %s\n", fname.c_str() );
         *buffer = 0;
@@ -293,8 +335,11 @@ bool SingleThreadConvolver::get_buffer(std::string fname, float **buffer, uint32
     }
     *buffer = cbuffer;
     audio.close();
+    readTimer.stop();
     if (*rate != samplerate) {
-        *buffer = resamp.process(*rate, *asize, *buffer, samplerate, asize);
+        ratatouille::PhaseTimer t(profile, ratatouille::PHASE_RESAMPLE);
+        *buffer = resamp.process(*rate, *asize, cbuffer, samplerate, asize);
+        delete[] cbuffer;
         if (!*buffer) {
             printf("no buffer\n");
             return false;
@@ -348,7 +393,13 @@ bool SingleThreadConvolver::configure(std::string fname, float gain, unsigned in
     }
     normalize(abuf, asize);
 
-    if (init(1024, abuf, asize)) {
+    bool ret;
+    {
+        ratatouille::PhaseTimer t(profile, ratatouille::PHASE_PARTITION);
+        ret = init(1024, abuf, asize);
+    }
+    if (ret) {
+        memory = fft_convolver_memory(1024, asize);
         ready = true;
         delete[] abuf;
         return true;
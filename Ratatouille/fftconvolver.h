@@ -23,6 +23,7 @@
 #include "TwoStageFFTConvolver.h"
 #include "ParallelThread.h"
 #include "gx_resampler.h"
+#include "RatatouilleProfile.h"
 
 
 class Audiofile {
@@ -113,22 +114,29 @@ public:
 
     inline void set_samplerate(uint32_t sr) { samplerate = sr;}
 
+    inline void set_profile(ratatouille::LoadProfile* p) { profile = p;}
+
+    // bytes held by the partitions and buffers of the convolver
+    inline size_t memory_usage() { return memory;}
+
     int stop_process() {
             ready = false;
             return 0;}
 
     int cleanup () {
             reset();
+            memory = 0;
             return 0;}
 
     DoubleThreadConvolver()
-        : resamp(), ready(false), samplerate(0), pro() {
+        : resamp(), ready(false), samplerate(0), memory(0), profile(nullptr),
+          trace(ratatouille::Tracer::get().add("convolver")), pro() {
             pro.setTimeOut(200);
             pro.set<DoubleThreadConvolver, &DoubleThreadConvolver::backgroundProcessing>(this);
             pro.setThreadName("Convolver");
             norm = 0;}
 
-    ~DoubleThreadConvolver() { reset(); pro.stop();}
+    ~DoubleThreadConvolver() { reset(); pro.stop(); ratatouille::Tracer::get().remove(trace);}
 
 protected:
     virtual void startBackgroundProcessing();
@@ -137,11 +145,16 @@ protected:
 private:
     friend class ParallelThread;
     gx_resample::BufferResampler resamp;
-    void backgroundProcessing() { return doBackgroundProcessing();}
+    void backgroundProcessing() {
+        ratatouille::TraceScope t(trace, "tail");
+        return doBackgroundProcessing();}
     volatile bool ready;
     uint32_t buffersize;
     uint32_t samplerate;
     uint32_t norm;
+    size_t memory;
+    ratatouille::LoadProfile* profile;
+    ratatouille::TraceRing* trace;
     std::string filename;
     ParallelThread pro;
     std::atomic<bool> setWait;
@@ -172,16 +185,22 @@ public:
 
     inline void set_samplerate(uint32_t sr) { samplerate = sr;}
 
+    inline void set_profile(ratatouille::LoadProfile* p) { profile = p;}
+
+    // bytes held by the partitions and buffers of the convolver
+    inline size_t memory_usage() { return memory;}
+
     int stop_process() {
             ready = false;
             return 0;}
 
     int cleanup () {
             reset();
+            memory = 0;
             return 0;}
 
     SingleThreadConvolver()
-        : resamp(), ready(false), samplerate(0) { norm = 0;}
+        : resamp(), ready(false), samplerate(0), memory(0), profile(nullptr) { norm = 0;}
 
     ~SingleThreadConvolver() { reset();}
 
@@ -191,6 +210,8 @@ private:
     uint32_t buffersize;
     uint32_t samplerate;
     uint32_t norm;
+    size_t memory;
+    ratatouille::LoadProfile* profile;
     std::string filename;
     bool get_buffer(std::string fname, float **buffer, uint32_t* rate, int* size);
     void normalize(float* buffer, int asize);
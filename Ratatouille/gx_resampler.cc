@@ -47,6 +47,19 @@ static uint32_t gcd (int32_t a, int32_t b)
   return 1;
 }
 
+// bytes of the buffer allocated by Resampler::setup(fs_inp, fs_out, nchan, hlen),
+// the filter table is shared by all resamplers with the same parameters
+// and counted once by Resampler_table::memory()
+static size_t resampler_memory(const Resampler& r, int32_t fs_inp, int32_t fs_outp)
+{
+  if (!r.inpsize() || !fs_inp || !fs_outp) return 0;
+  const size_t h = r.inpsize() / 2;
+  size_t k = 250;
+  if (fs_outp < fs_inp)
+    k = static_cast<size_t>(ceil(k * static_cast<double>(fs_inp) / fs_outp));
+  return sizeof(float) * r.nchan() * (2 * h - 1 + k);
+}
+
 
 int FixedRateResampler::setup(int _inputRate, int _outputRate)
 {
@@ -54,6 +67,8 @@ int FixedRateResampler::setup(int _inputRate, int _outputRate)
     inputRate = _inputRate;
     outputRate = _outputRate;
     if (inputRate == outputRate) {
+	clear();
+	inputRate = outputRate = _inputRate;
 	return 0;
     }
     // upsampler
@@ -81,6 +96,25 @@ int FixedRateResampler::setup(int _inputRate, int _outputRate)
     return 0;
 }
 
+// release the buffers of a former setup
+void FixedRateResampler::clear()
+{
+    r_up.clear();
+    r_down.clear();
+    inputRate = outputRate = 0;
+}
+
+size_t FixedRateResampler::memory() const
+{
+    return resampler_memory(r_up, inputRate, outputRate) +
+           resampler_memory(r_down, outputRate, inputRate);
+}
+
+size_t FixedRateResampler::sharedMemory()
+{
+    return Resampler_table::memory();
+}
+
 int FixedRateResampler::up(int count, float *input, float *output)
 {
     if (inputRate == outputRate) {
@@ -177,6 +211,7 @@ float *BufferResampler::process(int32_t fs_inp, int32_t ilen, float *input, int3
   const int32_t qual = 32;
   if (setup(fs_inp, fs_outp, 1, qual) != 0)
     {
+      clear();
       return 0;
     }
   // pre-fill with k/2-1 zeros
@@ -187,6 +222,7 @@ float *BufferResampler::process(int32_t fs_inp, int32_t ilen, float *input, int3
   out_data = 0;
   if (Resampler::process() != 0)
     {
+      clear();
       return 0;
     }
   inp_count = ilen;
@@ -196,6 +232,7 @@ float *BufferResampler::process(int32_t fs_inp, int32_t ilen, float *input, int3
   if (Resampler::process() != 0)
     {
       delete[] p;
+      clear();
       return 0;
     }
   inp_data = 0;
@@ -203,11 +240,15 @@ float *BufferResampler::process(int32_t fs_inp, int32_t ilen, float *input, int3
   if (Resampler::process() != 0)
     {
       delete[] p;
+      clear();
       return 0;
     }
-  assert(inp_count == 0);
+  // when downsampling the output buffer may be full before all
+  // flush zeros are read, so inp_count could be left > 0 here
   assert(out_count <= 1);
   *olen = nout - out_count;
+  // the filter table and buffer are only needed for this call
+  clear();
   //printf("resampled from %i to: %i\n",fs_inp, fs_outp );
   return p;
 }
@@ -45,6 +45,11 @@ public:
     void down(float *input, float *output);
     int max_out_count(int in_count) {
 	return static_cast<int>(ceil((in_count*static_cast<double>(outputRate))/inputRate)); }
+    void clear();
+    size_t memory() const; // bytes of the buffers of both resamplers
+    // bytes of the filter tables of all resamplers in the process,
+    // each table is shared by the resamplers with the same rates
+    static size_t sharedMemory();
 };
 
 class SimpleResampler
@@ -78,9 +83,11 @@ private:
   int32_t ratio_b;
 public:
   bool setup(int32_t srcRate, int32_t dstRate, int32_t nchan);
+  // Resampler::process() only read the next input sample when there
+  // is room for one more output sample, so round up and add one
   int32_t get_max_out_size(int32_t i_size)
   {
-    return (i_size * ratio_b) / ratio_a + 1;
+    return (i_size * ratio_b + ratio_a - 1) / ratio_a + 1;
   }
   int32_t process(int32_t count, float *input, float *output);
   int32_t flush(float *output); // check source for max. output size
@@ -204,6 +204,8 @@ static void draw_window(void *w_, void* user_data) {
             ps->ma.filebutton->flags &= ~HAS_TOOLTIP;
             hide_tooltip(ps->ma.filebutton);
         }
+        // show the load stage while the file is on the way
+        if (ps->ma.status[0]) strcpy(label, ps->ma.status);
 
         cairo_text_extents(w->crb, label, &extents_f);
         double twf = extents_f.width/2.0;
@@ -227,6 +229,7 @@ static void draw_window(void *w_, void* user_data) {
             ps->mb.filebutton->flags &= ~HAS_TOOLTIP;
             hide_tooltip(ps->mb.filebutton);
         }
+        if (ps->mb.status[0]) strcpy(label, ps->mb.status);
 
         cairo_text_extents(w->crb, label, &extents_f);
         double twf = extents_f.width/2.0;
@@ -250,6 +253,7 @@ static void draw_window(void *w_, void* user_data) {
             ps->ir.filebutton->flags &= ~HAS_TOOLTIP;
             hide_tooltip(ps->ir.filebutton);
         }
+        if (ps->ir.status[0]) strcpy(label, ps->ir.status);
 
         cairo_text_extents(w->crb, label, &extents_f);
         double twf = extents_f.width/2.0;
@@ -273,12 +277,23 @@ static void draw_window(void *w_, void* user_data) {
             ps->ir1.filebutton->flags &= ~HAS_TOOLTIP;
             hide_tooltip(ps->ir1.filebutton);
         }
+        if (ps->ir1.status[0]) strcpy(label, ps->ir1.status);
 
         cairo_text_extents(w->crb, label, &extents_f);
         double twf = extents_f.width/2.0;
         cairo_move_to (w->crb, max(100 * w->app->hdpi,(w->scale.init_width*0.5)-twf), 384 * w->app->hdpi );
         cairo_show_text(w->crb, label);
     }
+    // performance overlay, the text is formatted in plugin_idle()
+    if (ps->perf.valid) {
+        cairo_set_font_size (w->crb, w->app->small_font);
+        if (ps->perf.alarm) cairo_set_source_rgba(w->crb, 0.894, 0.259, 0.259, 1.0);
+        cairo_move_to (w->crb, 35 * w->app->hdpi, 227 * w->app->hdpi);
+        cairo_show_text(w->crb, ps->perf.line[0]);
+        cairo_move_to (w->crb, 35 * w->app->hdpi, 239 * w->app->hdpi);
+        cairo_show_text(w->crb, ps->perf.line[1]);
+        use_text_color_scheme(w, NORMAL_);
+    }
 #endif
 #ifndef HIDE_NAME
     cairo_set_font_size (w->crb, w->app->big_font+8);
@@ -985,6 +1000,7 @@ static int ui_idle(LV2UI_Handle handle) {
         if (ui->loop_counter == 0)
             first_loop(ui);
     }
+    plugin_idle(ui);
 #endif
     return 0;
 }
@@ -76,6 +76,9 @@ typedef struct {
 // inform the engine that the GUI is loaded
 void first_loop(X11_UI *ui);
 
+// called on each ui_idle, do throttled updates here
+void plugin_idle(X11_UI *ui);
+
 // controller value changed, forward value to host when needed
 void plugin_value_changed(X11_UI *ui, Widget_t *w, PortIndex index);
 
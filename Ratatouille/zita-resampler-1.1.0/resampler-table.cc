@@ -159,3 +159,18 @@ void Resampler_table::print_list (void)
     printf ("----\n\n");
 }
 
+
+size_t Resampler_table::memory (void)
+{
+    Resampler_table *P;
+    size_t n = 0;
+
+    _mutex.lock ();
+    for (P = _list; P; P = P->_next)
+    {
+	n += sizeof (Resampler_table) + sizeof (float) * P->_hl * (P->_np + 1);
+    }
+    _mutex.unlock ();
+    return n;
+}
+
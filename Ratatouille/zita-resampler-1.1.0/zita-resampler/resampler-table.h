@@ -23,6 +23,7 @@
 
 
 #include <pthread.h>
+#include <stddef.h>
 
 
 #define ZITA_RESAMPLER_MAJOR_VERSION 1
@@ -53,6 +54,7 @@ class Resampler_table
 public:
 
     static void print_list (void);
+    static size_t memory (void);
 
 private:
 